@@ -15,4 +15,18 @@
 
 #define FILENAME_MAX_SIZE 200
 
+#define QUAD_CAPACITY 8
+#define QUAD_LOOSENESS 1.0f
+#define QUAD_MAX_DEPTH 10
+#define QUAD_MIN_SIZE 4
+// Leave merging to a compaction pass of up to QUAD_COMPACT_BUDGET microseconds a frame.
+#define QUAD_LAZY true
+#define QUAD_COMPACT_BUDGET 500
+// Lay the nodes out again once quad_fragmentation passes this.
+#define QUAD_RELAYOUT_THRESHOLD 0.5f
+
+#define SPATIAL_INDEX SPATIAL_QUADTREE
+#define GRID_CELL_SIZE 64
+#define AABB_MARGIN 4
+
 #endif
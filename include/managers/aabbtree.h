@@ -0,0 +1,106 @@
+#ifndef AABBTREE_H
+#define AABBTREE_H
+
+#include <SDL2/SDL.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "quadquery.h"
+#include "../entities/entity.h"
+
+/***************************************************************************
+ * A dynamic bounding volume tree, every entity is a leaf holding its      *
+ * position widened by a margin and every branch the union of its two      *
+ * children. Leaves are placed to keep the branches small and the tree is  *
+ * rotated to stay balanced, an entity is only moved once it leaves its    *
+ * widened box.                                                            *
+ ***************************************************************************/
+
+// Index of no node.
+#define AABB_NULL -1
+
+/**
+ * A node of the tree, kept in one array and linked by index.
+ */
+typedef struct AABBNode
+{
+    // Widened position for a leaf, union of the children for a branch.
+    SDL_Rect box;
+    // The entity of a leaf, NULL for a branch.
+    Entity *entity;
+    // The parent, or the next free node once released.
+    int32_t parent;
+    int32_t left;
+    int32_t right;
+    // 0 for a leaf, -1 once released.
+    int32_t height;
+} AABBNode;
+
+/**
+ * The dynamic AABB tree.
+ */
+typedef struct AABBTree
+{
+    AABBNode *nodes;
+    int32_t node_count;
+    int32_t node_maximum;
+    int32_t root;
+    // Released nodes waiting for reuse.
+    int32_t free_list;
+    // Pixels a leaf is widened by on each side.
+    int margin;
+    // Number of entities stored.
+    uint32_t count;
+} AABBTree;
+
+/**
+ * Initialize an empty tree with leaves widened by margin.
+ */
+bool aabb_init(AABBTree *tree, int margin);
+
+/**
+ * Free the tree.
+ */
+void aabb_free(AABBTree *tree);
+
+/**
+ * Take every entity out of the tree.
+ */
+void aabb_clear(AABBTree *tree);
+
+/**
+ * Insert an entity into the tree.
+ */
+bool aabb_insert(AABBTree *tree, Entity *entity);
+
+/**
+ * Remove an entity from the tree, it must not have moved since it was
+ * inserted or last updated.
+ */
+bool aabb_remove(AABBTree *tree, Entity *entity);
+
+/**
+ * Move an entity whose position has changed from old_position, nothing is
+ * done while it stays inside its widened box.
+ */
+bool aabb_update(AABBTree *tree, Entity *entity, SDL_Rect old_position);
+
+/**
+ * Visit every entity overlapping rect, returns the number visited.
+ */
+size_t aabb_visit_rect(AABBTree *tree, SDL_Rect rect, QuadVisitor visit, void *data);
+
+/**
+ * Returns an entity under the centre of point, or NULL if there is none.
+ */
+Entity *aabb_find_entity(AABBTree *tree, SDL_Rect point);
+
+/**
+ * Collect the k entities whose centres are closest to point, nearest first.
+ * Returns the number written to found.
+ */
+size_t aabb_query_knn(AABBTree *tree, SDL_Point point, size_t k, Entity **found);
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef LINEARQUADTREE_H
+#define LINEARQUADTREE_H
+
+#include <SDL2/SDL.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "quadquery.h"
+#include "../util/camera.h"
+#include "../entities/entity.h"
+
+/*****************************************************************************
+ * A pointerless quad tree, entities are kept sorted by the Morton code of   *
+ * their centre and a leaf is the range of codes under a quadrent that holds *
+ * no more than capacity entities.                                           *
+ *****************************************************************************/
+
+/**
+ * The linear quad tree.
+ */
+typedef struct LinearQuadTree
+{
+    // The bounds of the tree.
+    SDL_Rect bounds;
+    // Morton codes of the entity centres, sorted ascending.
+    uint32_t *codes;
+    // The entities, in the same order as their codes.
+    Entity **entities;
+    // Number of entities stored.
+    uint32_t count;
+    // Space allocated for entities.
+    uint32_t maximum;
+    // Entities whose centre is outside of the bounds, checked by every query.
+    Entity **outside;
+    uint32_t outside_count;
+    uint32_t outside_maximum;
+    // Furthest any entity reaches past its centre, queries look this far out.
+    int reach;
+    // Maximum number of entities in a leaf range.
+    uint16_t capacity;
+} LinearQuadTree;
+
+/**
+ * Initialize the linear quad tree with leaves holding up to capacity entities.
+ */
+bool lquad_init_tree(LinearQuadTree *quad, SDL_Rect bounds, uint16_t capacity);
+
+/**
+ * Free linear quad tree.
+ */
+void lquad_free_tree(LinearQuadTree *quad);
+
+/**
+ * Take every entity out of the linear quad tree.
+ */
+void lquad_clear(LinearQuadTree *quad);
+
+/**
+ * Returns the pointer to the stored entity under the centre of point on
+ * success, and NULL if no entity was found.
+ */
+Entity *lquad_find_entity(LinearQuadTree *quad, SDL_Rect point);
+
+/**
+ * Visit every entity overlapping rect, returns the number visited.
+ */
+size_t lquad_visit_rect(LinearQuadTree *quad, SDL_Rect rect, QuadVisitor visit, void *data);
+
+/**
+ * Collect up to maximum entities overlapping rect, returns the number written
+ * to found.
+ */
+size_t lquad_query_rect(LinearQuadTree *quad, SDL_Rect rect, Entity **found, size_t maximum);
+
+/**
+ * Collect the k entities whose centres are closest to point, nearest first.
+ * Returns the number written to found.
+ */
+size_t lquad_query_knn(LinearQuadTree *quad, SDL_Point point, size_t k, Entity **found);
+
+/**
+ * Insert an entity into the linear quad tree.
+ */
+bool lquad_insert_entity(LinearQuadTree *quad, Entity *entity);
+
+/**
+ * Remove the entity under the centre of point from the linear quad tree.
+ */
+bool lquad_remove_entity(LinearQuadTree *quad, SDL_Rect point);
+
+/**
+ * Take an entity out of the linear quad tree without marking it for cleanup,
+ * it must not have moved since it was inserted or last updated.
+ */
+bool lquad_detach_entity(LinearQuadTree *quad, Entity *entity);
+
+/**
+ * Move an entity whose position has changed from old_position.
+ */
+bool lquad_update_entity(LinearQuadTree *quad, Entity *entity, SDL_Rect old_position);
+
+#endif
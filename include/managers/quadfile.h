@@ -0,0 +1,99 @@
+#ifndef QUADFILE_H
+#define QUADFILE_H
+
+#include <SDL2/SDL.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "quadtree.h"
+#include "quadsnapshot.h"
+#include "../entities/entity.h"
+
+/***************************************************************************
+ * A tree saved to a flat file of offsets and indices, mapped back in and  *
+ * queried straight from the mapped pages. Entities are stored as indices  *
+ * into the array they were saved from.                                    *
+ ***************************************************************************/
+
+// "QUAD" read as a little endian integer.
+#define QUAD_FILE_MAGIC 0x44415551u
+#define QUAD_FILE_VERSION 2u
+
+/**
+ * The start of a saved tree, nodes and entries follow at their offsets.
+ */
+typedef struct QuadFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    // Written as 1 so a file from a machine of the other byte order is refused.
+    uint32_t byte_order;
+    uint16_t capacity;
+    uint16_t reserved;
+    float looseness;
+    // How far an entity can hang out of the loose bounds of its node.
+    int32_t margin;
+    uint32_t node_count;
+    uint32_t entry_count;
+    uint32_t entity_count;
+    // Byte offsets from the start of the file.
+    uint64_t nodes;
+    uint64_t entries;
+} QuadFileHeader;
+
+/**
+ * An entity as its index when saved and its position at the time.
+ */
+typedef struct QuadFileEntry
+{
+    uint32_t index;
+    SDL_Rect position;
+} QuadFileEntry;
+
+/**
+ * A saved tree mapped into memory, nodes are laid out like a snapshot.
+ */
+typedef struct QuadMap
+{
+    const QuadFileHeader *header;
+    const QuadSnapNode *nodes;
+    const QuadFileEntry *entries;
+    // The whole mapping.
+    void *base;
+    size_t size;
+    // Handle of the mapping object where the platform needs one.
+    void *mapping;
+} QuadMap;
+
+/**
+ * Save the tree to path, every entity it holds must be in entities and is
+ * written as its index there. Returns false on failure.
+ */
+bool quad_save_tree(QuadTree *quad, const char *path, Entity **entities, size_t count);
+
+/**
+ * Map a tree saved by quad_save_tree, the file is read lazily as it is
+ * queried. Returns false if it can not be mapped or is not a saved tree.
+ */
+bool quad_map_tree(QuadMap *map, const char *path);
+
+/**
+ * Unmap a tree mapped by quad_map_tree.
+ */
+void quad_unmap_tree(QuadMap *map);
+
+/**
+ * Find the index of the entity under the centre of point, returns false if
+ * there was none.
+ */
+bool quad_map_find_entity(const QuadMap *map, SDL_Rect point, uint32_t *index);
+
+/**
+ * Collect the indices of up to maximum entities overlapping rect, returns the
+ * number written to found.
+ */
+size_t quad_map_query_rect(const QuadMap *map, SDL_Rect rect, uint32_t *found, size_t maximum);
+
+#endif
@@ -0,0 +1,422 @@
+#ifndef QUADGENERIC_H
+#define QUADGENERIC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/***************************************************************************
+ * A quad tree over any payload and coordinate type, stamped out by macro  *
+ * so every instantiation is compiled for its own types. Declare it in a   *
+ * header with QUAD_GENERIC_DECLARE and define it once in a source file    *
+ * with QUAD_GENERIC_DEFINE, passing the same arguments to both:           *
+ *                                                                         *
+ *   QUAD_GENERIC_DECLARE(handles, uint32_t, float, 8)                     *
+ *   QUAD_GENERIC_DEFINE(handles, uint32_t, float, 8)                      *
+ *                                                                         *
+ * Payloads are copied by value and compared with ==, coordinates can be   *
+ * any integer or floating point type. Items are stored in the leaf under  *
+ * the centre of their box, every node tracks the reach of the boxes below *
+ * it so queries find items hanging over the edge of their leaf.           *
+ ***************************************************************************/
+
+// Deepest a generic tree splits to unless changed with prefix##_set_depth.
+#define QUAD_GENERIC_DEPTH 16
+
+/**
+ * Declare the types and functions of a tree called prefix.
+ */
+#define QUAD_GENERIC_DECLARE(prefix, payload, coord, capacity)                                    \
+    /* An axis aligned box spanning [x, x + w) by [y, y + h). */                                  \
+    typedef struct prefix##_box                                                                   \
+    {                                                                                             \
+        coord x;                                                                                  \
+        coord y;                                                                                  \
+        coord w;                                                                                  \
+        coord h;                                                                                  \
+    } prefix##_box;                                                                               \
+                                                                                                  \
+    /* A payload and the box it covers. */                                                        \
+    typedef struct prefix##_item                                                                  \
+    {                                                                                             \
+        payload value;                                                                            \
+        prefix##_box box;                                                                         \
+    } prefix##_item;                                                                              \
+                                                                                                  \
+    /* A node, the bucket holds capacity items before it spills to the heap. */                   \
+    typedef struct prefix##_node                                                                  \
+    {                                                                                             \
+        prefix##_box bounds;                                                                      \
+        /* Covers every box stored here and below, valid while total is above 0. */               \
+        prefix##_box reach;                                                                       \
+        /* The bucket unless it has spilled. */                                                   \
+        prefix##_item *items;                                                                     \
+        uint32_t count;                                                                           \
+        uint32_t room;                                                                            \
+        uint32_t total;                                                                           \
+        uint8_t depth;                                                                            \
+        struct prefix##_node *parent;                                                             \
+        /* Block of four children, null for a leaf. */                                            \
+        struct prefix##_node *children;                                                           \
+        prefix##_item bucket[capacity];                                                           \
+    } prefix##_node;                                                                              \
+                                                                                                  \
+    typedef struct prefix##_tree                                                                  \
+    {                                                                                             \
+        prefix##_node *root;                                                                      \
+        /* Deepest a node can be split to, only changed while the tree is empty. */               \
+        uint8_t max_depth;                                                                        \
+    } prefix##_tree;                                                                              \
+                                                                                                  \
+    /* Called for each item found, return false to stop the query. */                             \
+    typedef bool (*prefix##_visitor)(payload value, void *data);                                  \
+                                                                                                  \
+    bool prefix##_init(prefix##_tree *tree, prefix##_box bounds);                                 \
+    bool prefix##_set_depth(prefix##_tree *tree, uint8_t max_depth);                              \
+    void prefix##_free(prefix##_tree *tree);                                                      \
+    bool prefix##_insert(prefix##_tree *tree, payload value, prefix##_box box);                   \
+    bool prefix##_remove(prefix##_tree *tree, payload value, prefix##_box box);                   \
+    bool prefix##_find(const prefix##_tree *tree, coord x, coord y, payload *value);              \
+    size_t prefix##_visit_rect(const prefix##_tree *tree, prefix##_box rect,                      \
+                               prefix##_visitor visit, void *data);
+
+/**
+ * Define the functions of a tree declared with QUAD_GENERIC_DECLARE.
+ */
+#define QUAD_GENERIC_DEFINE(prefix, payload, coord, capacity)                                     \
+    /* Is the point inside the half open box? */                                                  \
+    static inline bool prefix##_holds(prefix##_box box, coord x, coord y)                         \
+    {                                                                                             \
+        return x >= box.x && x < box.x + box.w && y >= box.y && y < box.y + box.h;                \
+    }                                                                                             \
+                                                                                                  \
+    /* Is the point on or inside the box? */                                                      \
+    static inline bool prefix##_touches(prefix##_box box, coord x, coord y)                       \
+    {                                                                                             \
+        return x >= box.x && x <= box.x + box.w && y >= box.y && y <= box.y + box.h;              \
+    }                                                                                             \
+                                                                                                  \
+    static inline bool prefix##_overlaps(prefix##_box a, prefix##_box b)                          \
+    {                                                                                             \
+        return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;          \
+    }                                                                                             \
+                                                                                                  \
+    /* Smallest box covering both. */                                                             \
+    static inline prefix##_box prefix##_union(prefix##_box a, prefix##_box b)                     \
+    {                                                                                             \
+        coord x0 = a.x < b.x ? a.x : b.x;                                                         \
+        coord y0 = a.y < b.y ? a.y : b.y;                                                         \
+        coord x1 = a.x + a.w > b.x + b.w ? a.x + a.w : b.x + b.w;                                 \
+        coord y1 = a.y + a.h > b.y + b.h ? a.y + a.h : b.y + b.h;                                 \
+        return (prefix##_box){.x = x0, .y = y0, .w = x1 - x0, .h = y1 - y0};                      \
+    }                                                                                             \
+                                                                                                  \
+    /* Index of the child under the point, right and bottom own the centre lines. */              \
+    static inline int prefix##_quadrent(const prefix##_node *node, coord x, coord y)              \
+    {                                                                                             \
+        coord cx = node->bounds.x + node->bounds.w / 2;                                           \
+        coord cy = node->bounds.y + node->bounds.h / 2;                                           \
+        return (y >= cy) * 2 + (x >= cx);                                                         \
+    }                                                                                             \
+                                                                                                  \
+    static void prefix##_init_node(prefix##_node *node, prefix##_node *parent,                    \
+                                   prefix##_box bounds)                                           \
+    {                                                                                             \
+        node->bounds = bounds;                                                                    \
+        node->reach = bounds;                                                                     \
+        node->items = node->bucket;                                                               \
+        node->count = 0;                                                                          \
+        node->room = (capacity);                                                                  \
+        node->total = 0;                                                                          \
+        node->depth = parent ? parent->depth + 1 : 0;                                             \
+        node->parent = parent;                                                                    \
+        node->children = NULL;                                                                    \
+    }                                                                                             \
+                                                                                                  \
+    /* Make space for size items, spilling the bucket onto the heap. */                           \
+    static bool prefix##_reserve(prefix##_node *node, uint32_t size)                              \
+    {                                                                                             \
+        if (size <= node->room)                                                                   \
+            return true;                                                                          \
+                                                                                                  \
+        uint32_t room = node->room * 2 > size ? node->room * 2 : size;                            \
+        bool spilled = node->items != node->bucket;                                               \
+        prefix##_item *items = (prefix##_item *)realloc(spilled ? node->items : NULL,             \
+                                                        sizeof(prefix##_item) * room);            \
+        if (!items)                                                                               \
+            return false;                                                                         \
+        if (!spilled)                                                                             \
+            memcpy(items, node->bucket, sizeof(prefix##_item) * node->count);                     \
+                                                                                                  \
+        node->items = items;                                                                      \
+        node->room = room;                                                                        \
+        return true;                                                                              \
+    }                                                                                             \
+                                                                                                  \
+    static inline bool prefix##_can_split(const prefix##_tree *tree, const prefix##_node *node)   \
+    {                                                                                             \
+        return node->depth < tree->max_depth && node->bounds.w / 2 > 0 &&                         \
+               node->bounds.h / 2 > 0;                                                            \
+    }                                                                                             \
+                                                                                                  \
+    /* Split a full leaf and push its items down. */                                              \
+    static bool prefix##_split(prefix##_node *node)                                               \
+    {                                                                                             \
+        prefix##_node *children = (prefix##_node *)malloc(sizeof(prefix##_node) * 4);             \
+        if (!children)                                                                            \
+            return false;                                                                         \
+                                                                                                  \
+        coord hw = node->bounds.w / 2;                                                            \
+        coord hh = node->bounds.h / 2;                                                            \
+        for (int q = 0; q < 4; q++)                                                               \
+        {                                                                                         \
+            prefix##_box bounds = {                                                               \
+                .x = q & 1 ? node->bounds.x + hw : node->bounds.x,                                \
+                .y = q & 2 ? node->bounds.y + hh : node->bounds.y,                                \
+                .w = q & 1 ? node->bounds.w - hw : hw,                                            \
+                .h = q & 2 ? node->bounds.h - hh : hh,                                            \
+            };                                                                                    \
+            prefix##_init_node(&children[q], node, bounds);                                       \
+        }                                                                                         \
+        node->children = children;                                                                \
+                                                                                                  \
+        /* A leaf only spills once it can not split, and max_depth only changes while */          \
+        /* the tree is empty, so the bucket never holds more than a child has room for. */        \
+        for (uint32_t i = 0; i < node->count; i++)                                                \
+        {                                                                                         \
+            prefix##_item item = node->items[i];                                                  \
+            prefix##_node *child = &children[prefix##_quadrent(                                   \
+                node, item.box.x + item.box.w / 2, item.box.y + item.box.h / 2)];                 \
+            child->reach = child->total ? prefix##_union(child->reach, item.box) : item.box;      \
+            child->items[child->count++] = item;                                                  \
+            child->total++;                                                                       \
+        }                                                                                         \
+        node->count = 0;                                                                          \
+        return true;                                                                              \
+    }                                                                                             \
+                                                                                                  \
+    /* Move every item below node into items, freeing the nodes on the way. */                    \
+    static uint32_t prefix##_gather(prefix##_node *node, prefix##_item *items, uint32_t count)    \
+    {                                                                                             \
+        memcpy(&items[count], node->items, sizeof(prefix##_item) * node->count);                  \
+        count += node->count;                                                                     \
+        if (node->items != node->bucket)                                                          \
+            free(node->items);                                                                    \
+                                                                                                  \
+        if (node->children)                                                                       \
+        {                                                                                         \
+            for (int q = 0; q < 4; q++)                                                           \
+                count = prefix##_gather(&node->children[q], items, count);                        \
+            free(node->children);                                                                 \
+        }                                                                                         \
+        return count;                                                                             \
+    }                                                                                             \
+                                                                                                  \
+    /* Free the spilled bucket and every descendant of a node, leaving the node. */               \
+    static void prefix##_release(prefix##_node *node)                                             \
+    {                                                                                             \
+        if (node->items != node->bucket)                                                          \
+            free(node->items);                                                                    \
+        if (node->children)                                                                       \
+        {                                                                                         \
+            for (int q = 0; q < 4; q++)                                                           \
+                prefix##_release(&node->children[q]);                                             \
+            free(node->children);                                                                 \
+        }                                                                                         \
+    }                                                                                             \
+                                                                                                  \
+    /* Turn a branch back into a leaf, its subtree must fit in the bucket. */                     \
+    static void prefix##_collapse(prefix##_node *node)                                            \
+    {                                                                                             \
+        for (int q = 0; q < 4; q++)                                                               \
+            node->count = prefix##_gather(&node->children[q], node->items, node->count);          \
+        free(node->children);                                                                     \
+        node->children = NULL;                                                                    \
+                                                                                                  \
+        /* Removals leave the reach wide, tighten it while the items are at hand. */              \
+        for (uint32_t i = 0; i < node->count; i++)                                                \
+            node->reach = i ? prefix##_union(node->reach, node->items[i].box)                     \
+                            : node->items[i].box;                                                 \
+    }                                                                                             \
+                                                                                                  \
+    static bool prefix##_search_point(const prefix##_node *node, coord x, coord y,                \
+                                      payload *value)                                             \
+    {                                                                                             \
+        if (node->total == 0 || !prefix##_touches(node->reach, x, y))                             \
+            return false;                                                                         \
+                                                                                                  \
+        for (uint32_t i = 0; i < node->count; i++)                                                \
+        {                                                                                         \
+            if (prefix##_touches(node->items[i].box, x, y))                                       \
+            {                                                                                     \
+                *value = node->items[i].value;                                                    \
+                return true;                                                                      \
+            }                                                                                     \
+        }                                                                                         \
+                                                                                                  \
+        if (node->children)                                                                       \
+        {                                                                                         \
+            for (int q = 0; q < 4; q++)                                                           \
+            {                                                                                     \
+                if (prefix##_search_point(&node->children[q], x, y, value))                       \
+                    return true;                                                                  \
+            }                                                                                     \
+        }                                                                                         \
+        return false;                                                                             \
+    }                                                                                             \
+                                                                                                  \
+    /* Returns false once the visitor asks to stop. */                                            \
+    static bool prefix##_search_rect(const prefix##_node *node, prefix##_box rect,                \
+                                     prefix##_visitor visit, void *data, size_t *count)           \
+    {                                                                                             \
+        if (node->total == 0 || !prefix##_overlaps(node->reach, rect))                            \
+            return true;                                                                          \
+                                                                                                  \
+        for (uint32_t i = 0; i < node->count; i++)                                                \
+        {                                                                                         \
+            if (!prefix##_overlaps(node->items[i].box, rect))                                     \
+                continue;                                                                         \
+            (*count)++;                                                                           \
+            if (!visit(node->items[i].value, data))                                               \
+                return false;                                                                     \
+        }                                                                                         \
+                                                                                                  \
+        if (node->children)                                                                       \
+        {                                                                                         \
+            for (int q = 0; q < 4; q++)                                                           \
+            {                                                                                     \
+                if (!prefix##_search_rect(&node->children[q], rect, visit, data, count))          \
+                    return false;                                                                 \
+            }                                                                                     \
+        }                                                                                         \
+        return true;                                                                              \
+    }                                                                                             \
+                                                                                                  \
+    /* Initialize an empty tree over bounds. */                                                   \
+    bool prefix##_init(prefix##_tree *tree, prefix##_box bounds)                                  \
+    {                                                                                             \
+        tree->root = (prefix##_node *)malloc(sizeof(prefix##_node));                              \
+        if (!tree->root)                                                                          \
+            return false;                                                                         \
+        prefix##_init_node(tree->root, NULL, bounds);                                             \
+        tree->max_depth = QUAD_GENERIC_DEPTH;                                                     \
+        return true;                                                                              \
+    }                                                                                             \
+                                                                                                  \
+    /* Change how deep an empty tree splits, returns false if it holds anything. */               \
+    bool prefix##_set_depth(prefix##_tree *tree, uint8_t max_depth)                               \
+    {                                                                                             \
+        if (tree->root->total > 0)                                                                \
+            return false;                                                                         \
+        prefix##_release(tree->root);                                                             \
+        prefix##_init_node(tree->root, NULL, tree->root->bounds);                                 \
+        tree->max_depth = max_depth;                                                              \
+        return true;                                                                              \
+    }                                                                                             \
+                                                                                                  \
+    /* Free every node of the tree. */                                                            \
+    void prefix##_free(prefix##_tree *tree)                                                       \
+    {                                                                                             \
+        if (!tree->root)                                                                          \
+            return;                                                                               \
+        prefix##_release(tree->root);                                                             \
+        free(tree->root);                                                                         \
+        tree->root = NULL;                                                                        \
+    }                                                                                             \
+                                                                                                  \
+    /* Insert value covering box, its centre must be inside the tree. */                          \
+    bool prefix##_insert(prefix##_tree *tree, payload value, prefix##_box box)                    \
+    {                                                                                             \
+        coord x = box.x + box.w / 2;                                                              \
+        coord y = box.y + box.h / 2;                                                              \
+        prefix##_node *node = tree->root;                                                         \
+        if (!prefix##_holds(node->bounds, x, y))                                                  \
+            return false;                                                                         \
+                                                                                                  \
+        for (;;)                                                                                  \
+        {                                                                                         \
+            if (node->children)                                                                   \
+            {                                                                                     \
+                node = &node->children[prefix##_quadrent(node, x, y)];                            \
+                continue;                                                                         \
+            }                                                                                     \
+            if (node->count < node->room)                                                         \
+                break;                                                                            \
+            if (prefix##_can_split(tree, node))                                                   \
+            {                                                                                     \
+                if (!prefix##_split(node))                                                        \
+                    return false;                                                                 \
+                continue;                                                                         \
+            }                                                                                     \
+            if (!prefix##_reserve(node, node->count + 1))                                         \
+                return false;                                                                     \
+            break;                                                                                \
+        }                                                                                         \
+                                                                                                  \
+        node->items[node->count++] = (prefix##_item){.value = value, .box = box};                 \
+        for (prefix##_node *n = node; n; n = n->parent)                                           \
+        {                                                                                         \
+            n->reach = n->total ? prefix##_union(n->reach, box) : box;                            \
+            n->total++;                                                                           \
+        }                                                                                         \
+        return true;                                                                              \
+    }                                                                                             \
+                                                                                                  \
+    /* Remove value, box must be where it was inserted. */                                        \
+    bool prefix##_remove(prefix##_tree *tree, payload value, prefix##_box box)                    \
+    {                                                                                             \
+        coord x = box.x + box.w / 2;                                                              \
+        coord y = box.y + box.h / 2;                                                              \
+        prefix##_node *node = tree->root;                                                         \
+        if (!prefix##_holds(node->bounds, x, y))                                                  \
+            return false;                                                                         \
+        while (node->children)                                                                    \
+            node = &node->children[prefix##_quadrent(node, x, y)];                                \
+                                                                                                  \
+        uint32_t i = 0;                                                                           \
+        while (i < node->count && !(node->items[i].value == value))                               \
+            i++;                                                                                  \
+        if (i == node->count)                                                                     \
+            return false;                                                                         \
+        node->items[i] = node->items[--node->count];                                              \
+                                                                                                  \
+        /* Collapse the highest branch now small enough to be a leaf. */                          \
+        prefix##_node *merge = NULL;                                                              \
+        for (prefix##_node *n = node; n; n = n->parent)                                           \
+        {                                                                                         \
+            n->total--;                                                                           \
+            if (n->children && n->total <= ((capacity) + 1) / 2)                                  \
+                merge = n;                                                                        \
+        }                                                                                         \
+        if (merge)                                                                                \
+            prefix##_collapse(merge);                                                             \
+                                                                                                  \
+        /* Move a spilled leaf back into its bucket once everything fits. */                      \
+        if (!merge && node->items != node->bucket && node->count <= (capacity))                   \
+        {                                                                                         \
+            memcpy(node->bucket, node->items, sizeof(prefix##_item) * node->count);               \
+            free(node->items);                                                                    \
+            node->items = node->bucket;                                                           \
+            node->room = (capacity);                                                              \
+        }                                                                                         \
+        return true;                                                                              \
+    }                                                                                             \
+                                                                                                  \
+    /* Find a value whose box holds the point, returns false if there is none. */                 \
+    bool prefix##_find(const prefix##_tree *tree, coord x, coord y, payload *value)               \
+    {                                                                                             \
+        return prefix##_search_point(tree->root, x, y, value);                                    \
+    }                                                                                             \
+                                                                                                  \
+    /* Visit every value whose box overlaps rect, returns the number visited. */                  \
+    size_t prefix##_visit_rect(const prefix##_tree *tree, prefix##_box rect,                      \
+                               prefix##_visitor visit, void *data)                                \
+    {                                                                                             \
+        size_t count = 0;                                                                         \
+        prefix##_search_rect(tree->root, rect, visit, data, &count);                              \
+        return count;                                                                             \
+    }
+
+#endif
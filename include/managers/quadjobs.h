@@ -0,0 +1,104 @@
+#ifndef QUADJOBS_H
+#define QUADJOBS_H
+
+#include <SDL2/SDL.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "quadtree.h"
+#include "../entities/entity.h"
+
+/***************************************************************************
+ * A pool of threads running batches of independent read only queries     *
+ * against a tree that does not change until the batch is done.          *
+ ***************************************************************************/
+
+/**
+ * The kinds of query a batch can hold.
+ */
+typedef enum QuadQueryKind
+{
+    // The entity under the centre of rect, as quad_find_entity.
+    QUAD_QUERY_POINT,
+    // Entities overlapping rect, as quad_visit_rect.
+    QUAD_QUERY_RECT,
+    // The k entities nearest point, as quad_query_knn.
+    QUAD_QUERY_KNN
+} QuadQueryKind;
+
+/**
+ * A query in a batch and, once the batch has run, what it found.
+ */
+typedef struct QuadQuery
+{
+    QuadQueryKind kind;
+    SDL_Rect rect;
+    SDL_Point point;
+    size_t k;
+    // Results, valid until the pool runs its next batch.
+    Entity **found;
+    size_t count;
+    // Where the results landed.
+    int worker;
+    size_t offset;
+} QuadQuery;
+
+/**
+ * A worker and the buffer it writes results to.
+ */
+typedef struct QuadQueryWorker
+{
+    struct QuadQueryPool *pool;
+    SDL_Thread *thread;
+    Entity **results;
+    size_t count;
+    size_t maximum;
+    int index;
+    // Did a query run out of space for its results?
+    bool failed;
+} QuadQueryWorker;
+
+/**
+ * The pool of query threads.
+ */
+typedef struct QuadQueryPool
+{
+    // Workers, the first is the thread running the batch.
+    QuadQueryWorker *workers;
+    int worker_count;
+    SDL_mutex *lock;
+    // Signalled when a batch starts or the pool is closing.
+    SDL_cond *wake;
+    // Signalled when the last thread finishes a batch.
+    SDL_cond *done;
+    uint32_t generation;
+    int busy;
+    bool closing;
+    // The batch being run.
+    QuadTreeNode *node;
+    QuadQuery *queries;
+    size_t query_count;
+    SDL_atomic_t next;
+} QuadQueryPool;
+
+/**
+ * Start a pool of workers threads, counting the one running each batch, or
+ * one per CPU if workers is 0.
+ */
+bool quad_init_query_pool(QuadQueryPool *pool, int workers);
+
+/**
+ * Run every query of a batch against the tree under node across the pool,
+ * returning once they have all finished. Returns false if any query ran out
+ * of memory for its results.
+ */
+bool quad_run_queries(QuadQueryPool *pool, QuadTreeNode *node, QuadQuery *queries,
+                      size_t count);
+
+/**
+ * Stop the threads of the pool and free their results.
+ */
+void quad_free_query_pool(QuadQueryPool *pool);
+
+#endif
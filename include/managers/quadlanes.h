@@ -0,0 +1,34 @@
+#ifndef QUADLANES_H
+#define QUADLANES_H
+
+#include <SDL2/SDL.h>
+
+#include "quadtree.h"
+
+// Mask with a bit set for every child.
+#define QUAD_ALL_LANES 0xFu
+
+/****************************************************************************
+ * Tests of all four children of a node at once, against the bounds packed *
+ * into its lanes. Bit q of each mask is set for quadrent q.               *
+ ****************************************************************************/
+
+/**
+ * Pack the loose bounds of the children of node into its lanes.
+ */
+void quad_lanes_set(QuadTreeNode *node);
+
+/**
+ * Get the mask of children overlapping rect, as is_overlap would. If inside
+ * is given it receives the mask of children rect holds entirely, as
+ * is_inside would.
+ */
+unsigned quad_lanes_overlap(const QuadLanes *lanes, SDL_Rect rect, unsigned *inside);
+
+/**
+ * Get the mask of children whose bounds hold point, edges included as in
+ * is_collision.
+ */
+unsigned quad_lanes_hold(const QuadLanes *lanes, SDL_Point point);
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef QUADPOOL_H
+#define QUADPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct QuadTreeNode;
+
+/***************************************************************************
+ * A slab allocator handing out the four children of a split as one block. *
+ ***************************************************************************/
+
+/**
+ * A released block, reused before any new memory is carved from a slab.
+ */
+typedef struct QuadPoolBlock
+{
+    struct QuadPoolBlock *next;
+} QuadPoolBlock;
+
+/**
+ * The pool of node blocks.
+ */
+typedef struct QuadNodePool
+{
+    // Bytes in a block of four nodes and their buckets.
+    size_t block_size;
+    // Bucket capacity of each node.
+    uint16_t capacity;
+    // Blocks carved from each slab.
+    uint32_t blocks_per_slab;
+    // Every slab allocated so far.
+    void **slabs;
+    uint32_t slab_count;
+    uint32_t slab_maximum;
+    // Bytes held by every slab.
+    size_t bytes;
+    // Unused space in the newest slab.
+    char *cursor;
+    char *end;
+    // Released blocks waiting to be reused.
+    QuadPoolBlock *released;
+} QuadNodePool;
+
+/**
+ * Initialize the pool for nodes holding up to capacity entities.
+ */
+bool quad_init_pool(QuadNodePool *pool, uint16_t capacity);
+
+/**
+ * Allocate four contiguous nodes with their buckets wired up.
+ */
+struct QuadTreeNode *quad_pool_alloc(QuadNodePool *pool);
+
+/**
+ * Make sure the next blocks allocations are carved back to back from one
+ * slab, the pool must have no released blocks.
+ */
+bool quad_pool_reserve(QuadNodePool *pool, uint32_t blocks);
+
+/**
+ * Hand a block returned by quad_pool_alloc back to the pool.
+ */
+void quad_pool_release(QuadNodePool *pool, struct QuadTreeNode *block);
+
+/**
+ * Take over every slab and released block of other, leaving it empty. Both
+ * pools must hold nodes of the same capacity.
+ */
+bool quad_pool_adopt(QuadNodePool *pool, QuadNodePool *other);
+
+/**
+ * Free every slab in the pool, and with them every node ever allocated.
+ */
+void quad_free_pool(QuadNodePool *pool);
+
+#endif
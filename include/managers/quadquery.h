@@ -0,0 +1,97 @@
+#ifndef QUADQUERY_H
+#define QUADQUERY_H
+
+#include <SDL2/SDL.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "quadtree.h"
+#include "../entities/entity.h"
+
+/**
+ * Called for every entity a query finds, return false to stop the query.
+ */
+typedef bool (*QuadVisitor)(Entity *entity, void *data);
+
+/**
+ * An entity hit by a ray, at distance along the segment (0.0f is the start,
+ * 1.0f the end).
+ */
+typedef struct QuadHit
+{
+    Entity *entity;
+    float distance;
+} QuadHit;
+
+/**
+ * Called for every pair of overlapping entities found, return false to stop.
+ */
+typedef bool (*QuadPairVisitor)(Entity *first, Entity *second, void *data);
+
+/**
+ * Two entities whose positions overlap.
+ */
+typedef struct QuadPair
+{
+    Entity *first;
+    Entity *second;
+} QuadPair;
+
+/**
+ * Visit every entity overlapping rect, returns the number visited.
+ */
+size_t quad_visit_rect(QuadTreeNode *node, SDL_Rect rect, QuadVisitor visit, void *data);
+
+/**
+ * Collect up to maximum entities overlapping rect, returns the number written
+ * to found.
+ */
+size_t quad_query_rect(QuadTreeNode *node, SDL_Rect rect, Entity **found, size_t maximum);
+
+/**
+ * Visit every entity whose centre lies within radius of point, returns the
+ * number visited.
+ */
+size_t quad_visit_radius(QuadTreeNode *node, SDL_Point point, int radius, QuadVisitor visit,
+                         void *data);
+
+/**
+ * Collect up to maximum entities whose centre lies within radius of point,
+ * returns the number written to found.
+ */
+size_t quad_query_radius(QuadTreeNode *node, SDL_Point point, int radius, Entity **found,
+                         size_t maximum);
+
+/**
+ * Collect the k entities whose centres are closest to point, nearest first.
+ * Returns the number written to found, fewer than k if the tree runs out.
+ */
+size_t quad_query_knn(QuadTreeNode *node, SDL_Point point, size_t k, Entity **found);
+
+/**
+ * Cast a segment from start to end and return the first entity it hits, or
+ * NULL if it hits nothing. Sets distance to where the hit was if provided.
+ */
+Entity *quad_raycast(QuadTreeNode *node, SDL_Point start, SDL_Point end, float *distance);
+
+/**
+ * Cast a segment from start to end and collect up to maximum of the nearest
+ * entities it hits, nearest first. Returns the number written to hits.
+ */
+size_t quad_raycast_all(QuadTreeNode *node, SDL_Point start, SDL_Point end, QuadHit *hits,
+                        size_t maximum);
+
+/**
+ * Visit every pair of entities under node whose positions overlap, each pair
+ * once. Returns the number of pairs visited.
+ */
+size_t quad_visit_overlapping_pairs(QuadTreeNode *node, QuadPairVisitor visit, void *data);
+
+/**
+ * Collect up to maximum pairs of entities under node whose positions overlap,
+ * each pair once. Returns the number written to pairs.
+ */
+size_t quad_collect_overlapping_pairs(QuadTreeNode *node, QuadPair *pairs, size_t maximum);
+
+#endif
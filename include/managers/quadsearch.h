@@ -0,0 +1,210 @@
+#ifndef QUADSEARCH_H
+#define QUADSEARCH_H
+
+#include <SDL2/SDL.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "quadtree.h"
+#include "quadsnapshot.h"
+#include "quadwalk.h"
+#include "../entities/entity.h"
+#include "../util/camera.h"
+
+/****************************************************************************
+ * Pieces shared by the searches of every tree: squared distances from a   *
+ * point, a queue of nodes nearest first, a heap of the k nearest entities *
+ * and a depth first search over the flat nodes of a snapshot.             *
+ ****************************************************************************/
+
+// Nodes queued by a nearest neighbour search before spilling to the heap.
+#define QUAD_QUEUE_SIZE 128
+
+/**
+ * A node waiting to be searched, ordered by its distance from the point.
+ */
+typedef struct QuadQueued
+{
+    int64_t distance;
+    // A pointer or an index, whichever the tree uses for its nodes.
+    union
+    {
+        void *pointer;
+        uint32_t index;
+    } node;
+} QuadQueued;
+
+/**
+ * Min heap of nodes for a best first search.
+ */
+typedef struct QuadQueue
+{
+    QuadQueued *nodes;
+    size_t count;
+    size_t maximum;
+    // Inline storage used until the queue outgrows it.
+    QuadQueued local[QUAD_QUEUE_SIZE];
+} QuadQueue;
+
+/**
+ * An entity and its squared distance from the point of a search.
+ */
+typedef struct QuadRanked
+{
+    int64_t distance;
+    Entity *entity;
+} QuadRanked;
+
+/**
+ * The k nearest entities found so far, a max heap with the furthest on top.
+ */
+typedef struct QuadNearest
+{
+    QuadRanked *ranked;
+    size_t count;
+    size_t k;
+} QuadNearest;
+
+/**
+ * A caller supplied buffer being filled by a query.
+ */
+typedef struct QuadBuffer
+{
+    Entity **found;
+    size_t count;
+    size_t maximum;
+} QuadBuffer;
+
+/**
+ * A depth first search over the nodes of a snapshot or a mapped tree.
+ */
+typedef struct QuadFlatSearch
+{
+    const QuadSnapNode *nodes;
+    uint32_t node_count;
+    // Loose bounds are grown by this much, see quad_margin.
+    int margin;
+    uint32_t stack[QUAD_WALK_STACK];
+    int top;
+} QuadFlatSearch;
+
+/**
+ * Grow rect by amount on every side.
+ */
+static inline SDL_Rect quad_inflate(SDL_Rect rect, int amount)
+{
+    return (SDL_Rect){.x = rect.x - amount,
+                      .y = rect.y - amount,
+                      .w = rect.w + 2 * amount,
+                      .h = rect.h + 2 * amount};
+}
+
+/**
+ * Squared distance from the point to the closest edge of rect, 0 if inside.
+ */
+static inline int64_t quad_distance_to_rect(SDL_Rect rect, SDL_Point point)
+{
+    int64_t dx = point.x < rect.x            ? rect.x - point.x
+                 : point.x > rect.x + rect.w ? point.x - (rect.x + rect.w)
+                                             : 0;
+    int64_t dy = point.y < rect.y            ? rect.y - point.y
+                 : point.y > rect.y + rect.h ? point.y - (rect.y + rect.h)
+                                             : 0;
+    return dx * dx + dy * dy;
+}
+
+/**
+ * Squared distance from the point to the centre of rect.
+ */
+static inline int64_t quad_distance_to_centre(SDL_Rect rect, SDL_Point point)
+{
+    SDL_Point centre = get_rect_centre(rect);
+    int64_t dx = centre.x - point.x;
+    int64_t dy = centre.y - point.y;
+    return dx * dx + dy * dy;
+}
+
+/**
+ * Squared distance from the point to the furthest corner of rect.
+ */
+static inline int64_t quad_reach_of_rect(SDL_Rect rect, SDL_Point point)
+{
+    int64_t dx = point.x - rect.x > rect.x + rect.w - point.x ? point.x - rect.x
+                                                               : rect.x + rect.w - point.x;
+    int64_t dy = point.y - rect.y > rect.y + rect.h - point.y ? point.y - rect.y
+                                                               : rect.y + rect.h - point.y;
+    return dx * dx + dy * dy;
+}
+
+/**
+ * Initialize an empty queue using its inline storage.
+ */
+void quad_queue_init(QuadQueue *queue);
+
+/**
+ * Queue a node, growing onto the heap if the inline storage is full.
+ */
+bool quad_queue_push(QuadQueue *queue, QuadQueued queued);
+
+/**
+ * Take the closest node off the queue.
+ */
+QuadQueued quad_queue_pop(QuadQueue *queue);
+
+/**
+ * Free anything the queue grew onto.
+ */
+void quad_queue_free(QuadQueue *queue);
+
+/**
+ * Make room for the k nearest entities, returns false if memory ran out.
+ */
+bool quad_nearest_init(QuadNearest *nearest, size_t k);
+
+/**
+ * Could an entity or node at distance still make it into the k nearest?
+ */
+static inline bool quad_nearest_wants(const QuadNearest *nearest, int64_t distance)
+{
+    return nearest->count < nearest->k || distance < nearest->ranked[0].distance;
+}
+
+/**
+ * Offer an entity at distance to the k nearest.
+ */
+void quad_nearest_offer(QuadNearest *nearest, Entity *entity, int64_t distance);
+
+/**
+ * Write the nearest entities to found nearest first and free the heap,
+ * returns the number written.
+ */
+size_t quad_nearest_finish(QuadNearest *nearest, Entity **found);
+
+/**
+ * Append an entity to a QuadBuffer, stopping the query once it is full.
+ */
+bool quad_buffer_entity(Entity *entity, void *data);
+
+/**
+ * Start a depth first search from node 0 of nodes, whose entities hang out of
+ * their loose bounds by up to margin.
+ */
+void quad_flat_begin(QuadFlatSearch *search, const QuadSnapNode *nodes, uint32_t node_count,
+                     int margin);
+
+/**
+ * Get the next node, in quadrent order, that could hold an entity
+ * overlapping rect. The root is always given. Returns NULL once the search
+ * is over.
+ */
+const QuadSnapNode *quad_flat_next_rect(QuadFlatSearch *search, SDL_Rect rect);
+
+/**
+ * Get the next node, in quadrent order, that could hold an entity under
+ * point. The root is always given. Returns NULL once the search is over.
+ */
+const QuadSnapNode *quad_flat_next_point(QuadFlatSearch *search, SDL_Point point);
+
+#endif
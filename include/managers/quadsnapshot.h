@@ -0,0 +1,138 @@
+#ifndef QUADSNAPSHOT_H
+#define QUADSNAPSHOT_H
+
+#include <SDL2/SDL.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "quadtree.h"
+#include "quadquery.h"
+#include "../entities/entity.h"
+
+/***************************************************************************
+ * Read only copies of a tree, published by the thread that owns the tree *
+ * and queried by any number of others without locking.                   *
+ ***************************************************************************/
+
+// Snapshots kept, one current and the rest waiting on readers or reuse.
+#define QUAD_SNAPSHOT_BUFFERS 3
+
+/**
+ * A node of a snapshot, its four children sit side by side from children.
+ */
+typedef struct QuadSnapNode
+{
+    SDL_Rect bounds;
+    SDL_Rect loose;
+    // Entries stored in this node.
+    uint32_t first;
+    uint32_t count;
+    // Entries stored in this node and below.
+    uint32_t total;
+    // Index of the first child, 0 for a leaf (the root is never a child).
+    uint32_t children;
+} QuadSnapNode;
+
+/**
+ * An entity and where it was when the snapshot was taken.
+ */
+typedef struct QuadSnapEntry
+{
+    // Not copied, see quad_acquire_snapshot.
+    Entity *entity;
+    SDL_Rect position;
+} QuadSnapEntry;
+
+/**
+ * The tree as it was when published, node 0 is the root.
+ */
+typedef struct QuadSnapshot
+{
+    QuadSnapNode *nodes;
+    uint32_t node_count;
+    uint32_t node_maximum;
+    QuadSnapEntry *entries;
+    uint32_t entry_count;
+    uint32_t entry_maximum;
+    // How far an entity can hang out of the loose bounds of its node.
+    int margin;
+    // Number of the publish that filled this snapshot.
+    uint32_t frame;
+    // Readers holding this snapshot.
+    SDL_atomic_t readers;
+} QuadSnapshot;
+
+/**
+ * Where snapshots of one tree are published and picked up.
+ */
+typedef struct QuadSnapshots
+{
+    QuadSnapshot buffers[QUAD_SNAPSHOT_BUFFERS];
+    // The newest snapshot, NULL until the first publish.
+    void *current;
+    uint32_t frame;
+} QuadSnapshots;
+
+/**
+ * Initialize an empty set of snapshots.
+ */
+void quad_init_snapshots(QuadSnapshots *snapshots);
+
+/**
+ * Copy the tree into a snapshot no reader holds and make it current, called
+ * by the thread changing the tree. Returns false if every snapshot is still
+ * held or memory ran out, readers keep the previous one.
+ */
+bool quad_publish_snapshot(QuadSnapshots *snapshots, QuadTree *quad);
+
+/**
+ * Pick up the current snapshot, it stays unchanged until released. Returns
+ * NULL if nothing has been published.
+ *
+ * Only the tree is copied, the entities it hands out are still owned by the
+ * scene. clean_entities can free one while a reader holds the snapshot, so a
+ * reader must not dereference them unless it knows the owning thread is not
+ * cleaning up, and should rely on the positions the snapshot kept instead.
+ */
+const QuadSnapshot *quad_acquire_snapshot(QuadSnapshots *snapshots);
+
+/**
+ * Hand back a snapshot from quad_acquire_snapshot.
+ */
+void quad_release_snapshot(const QuadSnapshot *snapshot);
+
+/**
+ * Free every snapshot, no reader may hold one.
+ */
+void quad_free_snapshots(QuadSnapshots *snapshots);
+
+/**
+ * Returns the entity under the centre of point when the snapshot was taken,
+ * or NULL if there was none.
+ */
+Entity *quad_snapshot_find_entity(const QuadSnapshot *snapshot, SDL_Rect point);
+
+/**
+ * Visit every entity that overlapped rect when the snapshot was taken,
+ * returns the number visited.
+ */
+size_t quad_snapshot_visit_rect(const QuadSnapshot *snapshot, SDL_Rect rect, QuadVisitor visit,
+                                void *data);
+
+/**
+ * Collect up to maximum entities that overlapped rect when the snapshot was
+ * taken, returns the number written to found.
+ */
+size_t quad_snapshot_query_rect(const QuadSnapshot *snapshot, SDL_Rect rect, Entity **found,
+                                size_t maximum);
+
+/**
+ * Collect the k entities whose centres were closest to point when the
+ * snapshot was taken, nearest first. Returns the number written to found.
+ */
+size_t quad_snapshot_query_knn(const QuadSnapshot *snapshot, SDL_Point point, size_t k,
+                               Entity **found);
+
+#endif
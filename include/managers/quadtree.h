@@ -7,6 +7,22 @@
 
 #include "../util/camera.h"
 #include "../entities/entity.h"
+#include "quadpool.h"
+
+// Deepest a tree can get, each level halves bounds that fit in an int.
+#define QUAD_WALK_DEPTH 32
+
+/**
+ * The loose bounds of the four children of a node laid out side by side, lane
+ * q belongs to quadrent q and spans [x0, x1) by [y0, y1).
+ */
+typedef struct QuadLanes
+{
+    int32_t x0[QUADRENTS];
+    int32_t y0[QUADRENTS];
+    int32_t x1[QUADRENTS];
+    int32_t y1[QUADRENTS];
+} QuadLanes;
 
 /**
  * The node of the tree.
@@ -15,14 +31,97 @@ typedef struct QuadTreeNode
 {
     // The bounds of this node.
     SDL_Rect bounds;
-    // The entity stored in this node.
-    Entity *entity;
+    // The bounds entities stored here must fit in, wider than bounds in loose mode.
+    SDL_Rect loose;
+    // The entities stored in this node, the bucket unless it has spilled.
+    Entity **entities;
+    // The bucket following the node (sized to the tree capacity).
+    Entity **bucket;
+    // Number of entities stored in this node.
+    uint16_t count;
+    // Number of entities there is space for, above capacity once spilled.
+    uint16_t room;
+    // Levels below the root.
+    uint8_t depth;
+    // Number of entities stored in this node and all of its descendants.
+    uint32_t total;
     // The children of this node.
     struct QuadTreeNode *children[QUADRENTS];
+    // The loose bounds of the children, set when the node is split.
+    QuadLanes lanes;
     // The parent of this node, null if the root node.
     struct QuadTreeNode *parent;
+    // The tree this node belongs to.
+    struct QuadTree *tree;
+    // Has an entity been taken out of this subtree by the open batch, or by
+    // a lazy removal waiting for compaction?
+    bool dirty;
 } QuadTreeNode;
 
+/**
+ * Inserts and removals queued up to be applied to the tree together.
+ */
+typedef struct QuadBatch
+{
+    // Are operations being queued rather than applied?
+    bool open;
+    // Entities waiting to be inserted.
+    Entity **inserts;
+    uint32_t insert_count;
+    uint32_t insert_maximum;
+    // Entities waiting to be removed.
+    Entity **removes;
+    uint32_t remove_count;
+    uint32_t remove_maximum;
+} QuadBatch;
+
+/**
+ * Counters kept up to date as the tree is split and merged, read through
+ * quad_stats.
+ */
+typedef struct QuadCounters
+{
+    // Number of branches, each owns the block holding its four children.
+    uint32_t branches;
+    // Number of nodes at each depth, the root included.
+    uint32_t depths[QUAD_WALK_DEPTH + 1];
+    // Nodes whose bucket has spilled onto the heap, and the bytes spilled.
+    uint32_t spilled;
+    size_t spilled_bytes;
+    // Leaves split and branches merged since the last reset.
+    uint32_t splits;
+    uint32_t merges;
+    // Blocks allocated or released since the last relayout.
+    uint32_t scattered;
+} QuadCounters;
+
+/**
+ * The shape of a tree and what it is holding on to.
+ */
+typedef struct QuadStats
+{
+    uint32_t nodes;
+    uint32_t leaves;
+    uint32_t branches;
+    // Number of entities stored, queued inserts left out.
+    uint32_t entities;
+    // Entities over leaves, those loose mode keeps in branches included.
+    float entities_per_leaf;
+    // Number of nodes at each depth, the root included.
+    uint32_t depths[QUAD_WALK_DEPTH + 1];
+    // Deepest level with any nodes.
+    uint8_t depth;
+    // Nodes whose bucket has spilled onto the heap.
+    uint32_t spilled;
+    // Bytes allocated by the tree, slabs, spilled buckets and batch included.
+    size_t bytes;
+    // Leaves split and branches merged since the last reset.
+    uint32_t splits;
+    uint32_t merges;
+    // See quad_fragmentation.
+    float fragmentation;
+} QuadStats;
+
 /**
  * The quad tree.
  */
@@ -30,14 +129,70 @@ typedef struct QuadTree
 {
     // The root.
     QuadTreeNode *root;
-    // Number of nodes.
-    uint16_t size;
+    // Maximum number of entities a leaf holds before it is split.
+    uint16_t capacity;
+    // A branch holding this many entities or fewer is merged back into a leaf.
+    uint16_t merge_threshold;
+    // Deepest a node can be split to.
+    uint8_t max_depth;
+    // Smallest width or height a child node can have.
+    uint16_t min_size;
+    // Factor each node's loose bounds are scaled by, 1.0f places by centre only.
+    float looseness;
+    // Furthest any entity reaches past its centre, grows as entities are placed
+    // and starts over when the tree is rebuilt.
+    int reach;
+    // Where the children of every split are allocated from.
+    QuadNodePool pool;
+    // Operations waiting for the next commit.
+    QuadBatch batch;
+    // Shape of the tree, kept as it changes.
+    QuadCounters counters;
+    // Do removals leave merging to quad_compact?
+    bool lazy;
 } QuadTree;
 
 /**
- * Initialize the new QuadTree node.
+ * Initialize the new QuadTree with leaves holding up to capacity entities.
  */
-void quad_init_tree(QuadTree *quad, SDL_Rect bounds);
+void quad_init_tree(QuadTree *quad, SDL_Rect bounds, uint16_t capacity);
+
+/**
+ * How far an entity can hang out of the loose bounds of the node holding it,
+ * queries grow their bounds checks by this much. Always 0 in loose mode.
+ */
+int quad_margin(const QuadTree *quad);
+
+/**
+ * Switch an empty tree to loose mode, where the bounds of every node are
+ * scaled by looseness (above 1.0f) and each entity is stored in the deepest
+ * node whose loose bounds hold its whole position. Returns false if the tree
+ * is not empty.
+ */
+bool quad_set_loose(QuadTree *quad, float looseness);
+
+/**
+ * Limit how far an empty tree splits, nodes are never deeper than max_depth
+ * or narrower than min_size. A node that can not be split keeps anything past
+ * its capacity in a spilled bucket on the heap. Returns false if the tree is
+ * not empty.
+ */
+bool quad_set_limits(QuadTree *quad, uint8_t max_depth, uint16_t min_size);
+
+/**
+ * Switch removals between merging straight away and only taking the entity
+ * out of its bucket, leaving the merging for quad_compact. Anything left to
+ * compact is finished off when lazy removal is turned off.
+ */
+void quad_set_lazy(QuadTree *quad, bool lazy);
+
+/**
+ * Merge the branches lazy removals have left under the threshold and give
+ * back spilled buckets that fit again, for up to budget microseconds (0 for
+ * no limit). Work left over is picked up by the next call, returns true once
+ * there is none.
+ */
+bool quad_compact(QuadTree *quad, uint32_t budget);
 
 /**
  * Free quad tree.
@@ -51,19 +206,99 @@ void quad_free_tree(QuadTree *quad);
 QuadTreeNode *quad_find_node(QuadTreeNode *node, SDL_Rect point);
 
 /**
- * Returns the pointer to stored entity on success, and NULL
- * if no entity was found.
+ * Returns the pointer to the stored entity under the centre of point on
+ * success, and NULL if no entity was found.
  */
-QuadTreeNode *quad_find_entity(QuadTreeNode *node, SDL_Rect point);
+Entity *quad_find_entity(QuadTreeNode *node, SDL_Rect point);
 
 /**
- * Insert an entity into the quad tree.
+ * Insert an entity into the quad tree. Passed the root, the tree grows to
+ * meet an entity whose centre is outside it.
  */
 bool quad_insert_entity(QuadTreeNode *node, Entity *entity);
 
 /**
- * Remove an entity from the quad tree.
+ * Remove an entity from the quad tree, a lazy tree leaves any merging to
+ * quad_compact.
  */
 bool quad_remove_entity(QuadTreeNode *node, SDL_Rect point);
 
+/**
+ * Move an entity whose position has changed from old_position. The search
+ * starts from node, ideally the leaf holding the entity though any node in
+ * the tree works, which grows if the entity moves outside it. Returns false
+ * if the entity was not found or could not be placed again.
+ */
+bool quad_update_entity(QuadTreeNode *node, Entity *entity, SDL_Rect old_position);
+
+/**
+ * Replace the contents of the tree with the provided entities, built in one
+ * pass. Returns false if any entity could not be placed.
+ */
+bool quad_build_from_entities(QuadTree *quad, Entity **entities, size_t count);
+
+/**
+ * Replace the contents of the tree with the provided entities like
+ * quad_build_from_entities, splitting the work over workers threads (or one
+ * per CPU if workers is 0). Returns false if any entity could not be placed.
+ */
+bool quad_build_parallel(QuadTree *quad, Entity **entities, size_t count, int workers);
+
+/**
+ * Start queueing inserts and removals, the tree is left as it is until
+ * quad_batch_commit.
+ */
+void quad_batch_begin(QuadTree *quad);
+
+/**
+ * Queue an entity to be inserted on commit, it is inserted straight away if
+ * no batch is open.
+ */
+bool quad_batch_insert(QuadTree *quad, Entity *entity);
+
+/**
+ * Queue an entity to be removed on commit, it is removed straight away if no
+ * batch is open. The entity must not move until then.
+ */
+bool quad_batch_remove(QuadTree *quad, Entity *entity);
+
+/**
+ * Move an entity whose position has changed from old_position. One still
+ * queued for insertion is left to be placed where it is on commit, anything
+ * else is moved straight away.
+ */
+bool quad_batch_update(QuadTree *quad, Entity *entity, SDL_Rect old_position);
+
+/**
+ * Apply every queued operation, splitting and merging each node at most once,
+ * and close the batch. A lazy tree leaves the merging to quad_compact.
+ * Returns false if any operation could not be applied.
+ */
+bool quad_batch_commit(QuadTree *quad);
+
+/**
+ * Fill stats with the shape of the tree and the memory it holds, read from
+ * counters kept as it changes rather than a walk.
+ */
+void quad_stats(QuadTree *quad, QuadStats *stats);
+
+/**
+ * Start counting splits and merges again from zero.
+ */
+void quad_reset_stats(QuadTree *quad);
+
+/**
+ * How far the nodes have drifted from depth first order, 0 after a relayout
+ * rising towards 1 as blocks of children are allocated and released.
+ */
+float quad_fragmentation(QuadTree *quad);
+
+/**
+ * Copy every node below the root into one buffer in the depth first order
+ * the tree is walked in, so a walk reads memory almost sequentially. Any
+ * pointer to a node other than the root is left dangling. Returns false,
+ * leaving the tree as it was, if the buffer could not be allocated.
+ */
+bool quad_relayout(QuadTree *quad);
+
 #endif
@@ -0,0 +1,43 @@
+#ifndef QUADWALK_H
+#define QUADWALK_H
+
+#include <stdbool.h>
+
+#include "quadtree.h"
+
+/*************************************************************************
+ * Depth first traversal of a quad tree without recursion, every walk of *
+ * the tree goes through quad_walk or, when it needs its own order, an   *
+ * explicit stack of QUAD_WALK_STACK nodes.                              *
+ *************************************************************************/
+
+// Nodes a depth first search can have waiting at once, each level leaves three behind.
+#define QUAD_WALK_STACK (QUAD_WALK_DEPTH * (QUADRENTS - 1) + QUADRENTS)
+
+/**
+ * What the walk should do after visiting a node.
+ */
+typedef enum QuadWalkAction
+{
+    // Carry on into the children of the node.
+    QUAD_WALK_CONTINUE,
+    // Leave the children of the node out.
+    QUAD_WALK_SKIP,
+    // End the walk.
+    QUAD_WALK_STOP
+} QuadWalkAction;
+
+/**
+ * Called for a node during a walk.
+ */
+typedef QuadWalkAction (*QuadNodeVisitor)(QuadTreeNode *node, void *data);
+
+/**
+ * Walk the subtree under node depth first in quadrent order. Enter is called
+ * on the way down before any children, leave on the way back up after all
+ * of them, either may be NULL. Leave may release the children of the node it
+ * is given. Returns false if a visitor stopped the walk.
+ */
+bool quad_walk(QuadTreeNode *node, QuadNodeVisitor enter, QuadNodeVisitor leave, void *data);
+
+#endif
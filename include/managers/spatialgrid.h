@@ -0,0 +1,108 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <SDL2/SDL.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "quadquery.h"
+#include "../entities/entity.h"
+
+/***************************************************************************
+ * A uniform grid of square cells hashed into a fixed number of slots, so  *
+ * the world is unbounded and empty cells cost nothing. Each entity is     *
+ * stored once, in the cell under its centre.                              *
+ ***************************************************************************/
+
+/**
+ * An entity and the cell its centre is in.
+ */
+typedef struct GridEntry
+{
+    Entity *entity;
+    int32_t cx;
+    int32_t cy;
+} GridEntry;
+
+/**
+ * The entries of every cell hashed to one slot.
+ */
+typedef struct GridSlot
+{
+    GridEntry *entries;
+    uint32_t count;
+    uint32_t maximum;
+} GridSlot;
+
+/**
+ * The spatial hash grid.
+ */
+typedef struct SpatialGrid
+{
+    // Slots cells are hashed into, a power of two.
+    GridSlot *slots;
+    uint32_t slot_count;
+    // Width and height of a cell.
+    int cell_size;
+    // Number of entities stored.
+    uint32_t count;
+    // Widest and tallest entity stored, queries look this far past their rect.
+    int reach_w;
+    int reach_h;
+    // Range of cells that have held an entity.
+    int32_t min_cx;
+    int32_t min_cy;
+    int32_t max_cx;
+    int32_t max_cy;
+} SpatialGrid;
+
+/**
+ * Initialize an empty grid of cells cell_size across.
+ */
+bool grid_init(SpatialGrid *grid, int cell_size);
+
+/**
+ * Free the grid.
+ */
+void grid_free(SpatialGrid *grid);
+
+/**
+ * Take every entity out of the grid.
+ */
+void grid_clear(SpatialGrid *grid);
+
+/**
+ * Insert an entity into the grid.
+ */
+bool grid_insert(SpatialGrid *grid, Entity *entity);
+
+/**
+ * Remove an entity from the grid, it must not have moved since it was
+ * inserted or last updated.
+ */
+bool grid_remove(SpatialGrid *grid, Entity *entity);
+
+/**
+ * Move an entity whose position has changed from old_position.
+ */
+bool grid_update(SpatialGrid *grid, Entity *entity, SDL_Rect old_position);
+
+/**
+ * Visit every entity overlapping rect, returns the number visited.
+ */
+size_t grid_visit_rect(SpatialGrid *grid, SDL_Rect rect, QuadVisitor visit, void *data);
+
+/**
+ * Returns an entity under the centre of point, or NULL if there is none.
+ */
+Entity *grid_find_entity(SpatialGrid *grid, SDL_Rect point);
+
+/**
+ * Collect the k entities whose centres are closest to point, nearest first.
+ * Returns the number written to found.
+ */
+size_t grid_query_knn(SpatialGrid *grid, SDL_Point point, size_t k, Entity **found);
+
+#endif
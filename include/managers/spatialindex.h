@@ -0,0 +1,142 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <SDL2/SDL.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "quadtree.h"
+#include "quadquery.h"
+#include "../entities/entity.h"
+
+/***************************************************************************
+ * One interface over the structures a scene can index its entities with, *
+ * each suited to a different spread of entities.                          *
+ ***************************************************************************/
+
+/**
+ * The structures behind a spatial index.
+ */
+typedef enum SpatialKind
+{
+    // Splits where entities are dense, for clustered scenes.
+    SPATIAL_QUADTREE,
+    // Fixed cells hashed into slots, for evenly spread entities of similar size.
+    SPATIAL_GRID,
+    // Balanced tree of boxes, for sparse scenes and entities of mixed size.
+    SPATIAL_AABB_TREE,
+    // Entities sorted by Morton code, for scenes mostly queried and rarely changed.
+    SPATIAL_LINEAR_QUADTREE,
+} SpatialKind;
+
+/**
+ * What an index is holding on to.
+ */
+typedef struct SpatialStats
+{
+    size_t entities;
+    // Nodes, occupied slots or boxes depending on the structure.
+    size_t nodes;
+    size_t bytes;
+} SpatialStats;
+
+/**
+ * The functions a structure provides, index is the structure itself.
+ */
+typedef struct SpatialOps
+{
+    bool (*insert)(void *index, Entity *entity);
+    bool (*remove)(void *index, Entity *entity);
+    bool (*update)(void *index, Entity *entity, SDL_Rect old_position);
+    size_t (*query_rect)(void *index, SDL_Rect rect, QuadVisitor visit, void *data);
+    Entity *(*query_point)(void *index, SDL_Rect point);
+    size_t (*knn)(void *index, SDL_Point point, size_t k, Entity **found);
+    void (*clear)(void *index);
+    void (*stats)(void *index, SpatialStats *stats);
+    // Optional, structures without batching apply everything straight away.
+    void (*begin)(void *index);
+    bool (*commit)(void *index);
+    void (*free)(void *index);
+} SpatialOps;
+
+/**
+ * A spatial index and the structure behind it.
+ */
+typedef struct SpatialIndex
+{
+    SpatialKind kind;
+    const SpatialOps *ops;
+    void *index;
+} SpatialIndex;
+
+/**
+ * Initialize an empty index of the given kind, bounds is where the entities
+ * are expected to be.
+ */
+bool spatial_init(SpatialIndex *spatial, SpatialKind kind, SDL_Rect bounds);
+
+/**
+ * Free the index.
+ */
+void spatial_free(SpatialIndex *spatial);
+
+/**
+ * Insert an entity, queued until the commit if a batch is open.
+ */
+bool spatial_insert(SpatialIndex *spatial, Entity *entity);
+
+/**
+ * Remove an entity, queued until the commit if a batch is open. It must not
+ * have moved since it was inserted or last updated.
+ */
+bool spatial_remove(SpatialIndex *spatial, Entity *entity);
+
+/**
+ * Move an entity whose position has changed from old_position, one still
+ * queued for insertion by an open batch is placed where it is on commit.
+ */
+bool spatial_update(SpatialIndex *spatial, Entity *entity, SDL_Rect old_position);
+
+/**
+ * Visit every entity overlapping rect, returns the number visited.
+ */
+size_t spatial_query_rect(SpatialIndex *spatial, SDL_Rect rect, QuadVisitor visit, void *data);
+
+/**
+ * Returns an entity under the centre of point, or NULL if there is none.
+ */
+Entity *spatial_query_point(SpatialIndex *spatial, SDL_Rect point);
+
+/**
+ * Collect the k entities whose centres are closest to point, nearest first.
+ * Returns the number written to found.
+ */
+size_t spatial_knn(SpatialIndex *spatial, SDL_Point point, size_t k, Entity **found);
+
+/**
+ * Take every entity out of the index.
+ */
+void spatial_clear(SpatialIndex *spatial);
+
+/**
+ * Fill stats with what the index is holding on to.
+ */
+void spatial_stats(SpatialIndex *spatial, SpatialStats *stats);
+
+/**
+ * Start queueing inserts and removals where the structure supports it.
+ */
+void spatial_begin(SpatialIndex *spatial);
+
+/**
+ * Apply everything queued since spatial_begin.
+ */
+bool spatial_commit(SpatialIndex *spatial);
+
+/**
+ * The quad tree behind the index, or NULL if it is another structure.
+ */
+QuadTree *spatial_quadtree(SpatialIndex *spatial);
+
+#endif
@@ -7,7 +7,7 @@
 
 #include "../managers/assetstack.h"
 #include "../managers/entitymanager.h"
-#include "../managers/quadtree.h"
+#include "../managers/spatialindex.h"
 #include "../entities/entity.h"
 
 /**
@@ -29,7 +29,7 @@ typedef struct Scene
 {
     // Entities present in scene.
     EntityManager entities;
-    QuadTree spacial;
+    SpatialIndex spacial;
     // The scene specific event handler.
     void (*event_handler)();
     // Optional components of the scene.
@@ -39,9 +39,10 @@ typedef struct Scene
 } Scene;
 
 /**
- * Initialize the scene components.
+ * Initialize the scene components, indexing entities with the given kind of
+ * structure.
  */
-bool init_scene(Scene *scene);
+bool init_scene(Scene *scene, SpatialKind kind);
 
 /**
  * Free a scene.
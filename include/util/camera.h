@@ -43,7 +43,8 @@ SDL_Rect transform_right_angle_rect(SDL_Rect within, float x, float y, float wid
 bool is_collision(int x, int y, SDL_Rect position);
 
 /**
- * Check if provided rects overlap.
+ * Check if provided rects overlap, sharing an edge is not enough and an
+ * empty rect overlaps nothing.
  */
 bool is_overlap(SDL_Rect dest, SDL_Rect position);
 
@@ -62,6 +63,16 @@ SDL_Point get_rect_centre(SDL_Rect rect);
  */
 bool is_point_inside(SDL_Rect within, SDL_Point point);
 
+/**
+ * Get the quadrent of the point around the centre, points on the centre lines
+ * belong to the right and bottom quadrents like the bounds of a split.
+ */
 Quadrent get_dir(SDL_Point centre, SDL_Point point);
 
+/**
+ * Get the Morton (Z-order) code of a point on a 65536 x 65536 grid laid over
+ * the provided rectangle, points outside are clamped to the edge.
+ */
+uint32_t get_morton_code(SDL_Rect within, SDL_Point point);
+
 #endif
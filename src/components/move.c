@@ -15,6 +15,7 @@ void move(void *e, Direction d, int pixels, SDL_Rect bounds)
     }
     // INFO_LOG("Window = %d %d\n", screen_pos.w, screen_pos.h);
     Entity *entity = (Entity *)e;
+    SDL_Rect old_pos = entity->position;
     SDL_Rect new_pos = entity->position;
     switch (d)
     {
@@ -65,4 +66,7 @@ void move(void *e, Direction d, int pixels, SDL_Rect bounds)
     default:
         break;
     }
+
+    // Keep the spacial tree in step.
+    spatial_update(&gameData.scene->spacial, entity, old_pos);
 }
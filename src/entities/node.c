@@ -7,7 +7,7 @@
 static void destroy(void *e)
 {
     Entity *entity = (Entity *)e;
-    entity->components[Deleted].call();
+    entity->components[Deleted].call(entity);
 }
 
 /**
@@ -45,12 +45,30 @@ static void dbg(TTF_Font *fnt)
     sprintf(mouse, "Mouse Position: x %4d y %4d", x, y);
     char entities[100];
     sprintf(entities, "Entities: %5d", gameData.scene->entities.current);
+    SpatialStats stats;
+    spatial_stats(&gameData.scene->spacial, &stats);
+    char index[100];
+    sprintf(index, "Index: %6zu nodes %9zu bytes", stats.nodes, stats.bytes);
 
     // Render.
     render_debug_message(fnt, fps, 0);
     render_debug_message(fnt, camera, 1);
     render_debug_message(fnt, mouse, 2);
     render_debug_message(fnt, entities, 3);
+    render_debug_message(fnt, index, 4);
+
+    // How the quad tree has been splitting, if that is what holds the entities.
+    QuadTree *quad = spatial_quadtree(&gameData.scene->spacial);
+    if (quad)
+    {
+        QuadStats shape;
+        quad_stats(quad, &shape);
+        char tree[100];
+        sprintf(tree, "Depth: %2u Per leaf: %5.2f Splits: %6u Merges: %6u Scattered: %4.2f",
+                shape.depth, shape.entities_per_leaf, shape.splits, shape.merges,
+                shape.fragmentation);
+        render_debug_message(fnt, tree, 5);
+    }
 }
 
 /**
@@ -86,6 +104,8 @@ static void quit_modules(void)
  */
 static void handle_events(void)
 {
+    // Spacial changes are committed together when the entities are cleaned.
+    spatial_begin(&gameData.currentScene->spacial);
     while (SDL_PollEvent(&gameData.event))
     {
         if (gameData.event.type == SDL_QUIT)
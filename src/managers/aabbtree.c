@@ -0,0 +1,596 @@
+#include <SDL2/SDL.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../../include/debug.h"
+#include "../../include/managers/aabbtree.h"
+#include "../../include/managers/quadsearch.h"
+#include "../../include/util/camera.h"
+
+// Nodes a search can have waiting before spilling to the heap, far more than
+// a balanced tree ever needs.
+#define AABB_STACK 128
+
+/**
+ * A node waiting to be searched and the closest its box gets to the point.
+ */
+typedef struct AABBPending
+{
+    int32_t node;
+    int64_t distance;
+} AABBPending;
+
+/**
+ * Nodes waiting to be searched, last in first out.
+ */
+typedef struct AABBStack
+{
+    AABBPending *nodes;
+    size_t count;
+    size_t maximum;
+    // Inline storage used until the stack outgrows it.
+    AABBPending local[AABB_STACK];
+} AABBStack;
+
+// ---------------- Helper functions ----------------
+
+/**
+ * Smallest rect covering both.
+ */
+static inline SDL_Rect aabb_union(SDL_Rect a, SDL_Rect b)
+{
+    int x0 = a.x < b.x ? a.x : b.x;
+    int y0 = a.y < b.y ? a.y : b.y;
+    int x1 = a.x + a.w > b.x + b.w ? a.x + a.w : b.x + b.w;
+    int y1 = a.y + a.h > b.y + b.h ? a.y + a.h : b.y + b.h;
+    return (SDL_Rect){.x = x0, .y = y0, .w = x1 - x0, .h = y1 - y0};
+}
+
+/**
+ * Half the perimeter, the cost of a box when choosing where a leaf goes.
+ */
+static inline int64_t aabb_cost(SDL_Rect box)
+{
+    return (int64_t)box.w + box.h;
+}
+
+static inline int32_t aabb_max(int32_t a, int32_t b)
+{
+    return a > b ? a : b;
+}
+
+static inline bool aabb_is_leaf(const AABBNode *node)
+{
+    return node->left == AABB_NULL;
+}
+
+/**
+ * Start a search from the root, if there is one.
+ */
+static void aabb_stack_init(AABBStack *stack, const AABBTree *tree)
+{
+    stack->nodes = stack->local;
+    stack->maximum = AABB_STACK;
+    stack->count = 0;
+    if (tree->root != AABB_NULL)
+        stack->nodes[stack->count++] = (AABBPending){.node = tree->root, .distance = 0};
+}
+
+/**
+ * Push a node, growing onto the heap if the inline storage is full. Returns
+ * false if memory ran out, the search can not be finished.
+ */
+static bool aabb_stack_push(AABBStack *stack, int32_t node, int64_t distance)
+{
+    if (stack->count == stack->maximum)
+    {
+        size_t maximum = stack->maximum * 2;
+        AABBPending *nodes =
+            stack->nodes == stack->local
+                ? (AABBPending *)malloc(sizeof(AABBPending) * maximum)
+                : (AABBPending *)realloc(stack->nodes, sizeof(AABBPending) * maximum);
+        if (!nodes)
+        {
+            ERROR_LOG("Unable to grow an AABB tree search to %zu nodes!\n", maximum);
+            return false;
+        }
+        if (stack->nodes == stack->local)
+            memcpy(nodes, stack->local, sizeof(AABBPending) * stack->count);
+        stack->nodes = nodes;
+        stack->maximum = maximum;
+    }
+    stack->nodes[stack->count++] = (AABBPending){.node = node, .distance = distance};
+    return true;
+}
+
+/**
+ * Free anything the stack grew onto.
+ */
+static void aabb_stack_free(AABBStack *stack)
+{
+    if (stack->nodes != stack->local)
+        free(stack->nodes);
+}
+
+/**
+ * Take a node from the free list, growing the array if it is empty.
+ */
+static int32_t aabb_alloc(AABBTree *tree)
+{
+    if (tree->free_list == AABB_NULL)
+    {
+        int32_t maximum = tree->node_maximum ? tree->node_maximum * 2 : 64;
+        AABBNode *nodes = (AABBNode *)realloc(tree->nodes, sizeof(AABBNode) * maximum);
+        if (!nodes)
+        {
+            ERROR_LOG("Unable to grow the AABB tree to %d nodes!\n", maximum);
+            return AABB_NULL;
+        }
+
+        // Chain the new nodes onto the free list.
+        for (int32_t i = tree->node_maximum; i < maximum; i++)
+        {
+            nodes[i].parent = i + 1 < maximum ? i + 1 : AABB_NULL;
+            nodes[i].height = -1;
+        }
+        tree->nodes = nodes;
+        tree->free_list = tree->node_maximum;
+        tree->node_maximum = maximum;
+    }
+
+    int32_t index = tree->free_list;
+    AABBNode *node = &tree->nodes[index];
+    tree->free_list = node->parent;
+    node->parent = AABB_NULL;
+    node->left = AABB_NULL;
+    node->right = AABB_NULL;
+    node->height = 0;
+    node->entity = NULL;
+    tree->node_count++;
+    return index;
+}
+
+/**
+ * Put a node back on the free list.
+ */
+static void aabb_release(AABBTree *tree, int32_t index)
+{
+    tree->nodes[index].parent = tree->free_list;
+    tree->nodes[index].height = -1;
+    tree->free_list = index;
+    tree->node_count--;
+}
+
+/**
+ * Point the parent of old at its replacement, or make it the root.
+ */
+static void aabb_replace_child(AABBTree *tree, int32_t parent, int32_t old, int32_t replacement)
+{
+    if (parent == AABB_NULL)
+        tree->root = replacement;
+    else if (tree->nodes[parent].left == old)
+        tree->nodes[parent].left = replacement;
+    else
+        tree->nodes[parent].right = replacement;
+}
+
+/**
+ * Rotate the taller grandchild of a up if its children differ in height by
+ * more than one. Returns the node now in a's place.
+ */
+static int32_t aabb_balance(AABBTree *tree, int32_t ia)
+{
+    AABBNode *nodes = tree->nodes;
+    AABBNode *a = &nodes[ia];
+    if (aabb_is_leaf(a) || a->height < 2)
+        return ia;
+
+    int32_t ib = a->left;
+    int32_t ic = a->right;
+    AABBNode *b = &nodes[ib];
+    AABBNode *c = &nodes[ic];
+    int32_t balance = c->height - b->height;
+
+    // Rotate c up.
+    if (balance > 1)
+    {
+        int32_t i_f = c->left;
+        int32_t ig = c->right;
+        AABBNode *f = &nodes[i_f];
+        AABBNode *g = &nodes[ig];
+
+        c->left = ia;
+        c->parent = a->parent;
+        a->parent = ic;
+        aabb_replace_child(tree, c->parent, ia, ic);
+
+        // The taller of c's children stays with it.
+        int32_t kept = f->height > g->height ? i_f : ig;
+        int32_t moved = kept == i_f ? ig : i_f;
+        c->right = kept;
+        a->right = moved;
+        nodes[moved].parent = ia;
+        a->box = aabb_union(b->box, nodes[moved].box);
+        c->box = aabb_union(a->box, nodes[kept].box);
+        a->height = 1 + aabb_max(b->height, nodes[moved].height);
+        c->height = 1 + aabb_max(a->height, nodes[kept].height);
+        return ic;
+    }
+
+    // Rotate b up.
+    if (balance < -1)
+    {
+        int32_t id = b->left;
+        int32_t ie = b->right;
+        AABBNode *d = &nodes[id];
+        AABBNode *e = &nodes[ie];
+
+        b->left = ia;
+        b->parent = a->parent;
+        a->parent = ib;
+        aabb_replace_child(tree, b->parent, ia, ib);
+
+        int32_t kept = d->height > e->height ? id : ie;
+        int32_t moved = kept == id ? ie : id;
+        b->right = kept;
+        a->left = moved;
+        nodes[moved].parent = ia;
+        a->box = aabb_union(c->box, nodes[moved].box);
+        b->box = aabb_union(a->box, nodes[kept].box);
+        a->height = 1 + aabb_max(c->height, nodes[moved].height);
+        b->height = 1 + aabb_max(a->height, nodes[kept].height);
+        return ib;
+    }
+    return ia;
+}
+
+/**
+ * Rebalance and refit every branch from index up to the root.
+ */
+static void aabb_refit(AABBTree *tree, int32_t index)
+{
+    while (index != AABB_NULL)
+    {
+        index = aabb_balance(tree, index);
+        AABBNode *node = &tree->nodes[index];
+        AABBNode *left = &tree->nodes[node->left];
+        AABBNode *right = &tree->nodes[node->right];
+        node->height = 1 + aabb_max(left->height, right->height);
+        node->box = aabb_union(left->box, right->box);
+        index = node->parent;
+    }
+}
+
+/**
+ * Place a leaf next to the sibling that grows the tree the least.
+ */
+static bool aabb_insert_leaf(AABBTree *tree, int32_t leaf)
+{
+    if (tree->root == AABB_NULL)
+    {
+        tree->root = leaf;
+        tree->nodes[leaf].parent = AABB_NULL;
+        return true;
+    }
+
+    // Walk down while pushing the leaf into a child is cheaper than pairing here.
+    SDL_Rect box = tree->nodes[leaf].box;
+    int32_t index = tree->root;
+    while (!aabb_is_leaf(&tree->nodes[index]))
+    {
+        AABBNode *node = &tree->nodes[index];
+        int64_t area = aabb_cost(node->box);
+        int64_t combined = aabb_cost(aabb_union(node->box, box));
+        int64_t cost = 2 * combined;
+        // Every ancestor grows whichever way the leaf goes.
+        int64_t inherited = 2 * (combined - area);
+
+        int64_t costs[2];
+        int32_t children[2] = {node->left, node->right};
+        for (int i = 0; i < 2; i++)
+        {
+            AABBNode *child = &tree->nodes[children[i]];
+            int64_t grown = aabb_cost(aabb_union(child->box, box));
+            costs[i] = inherited + (aabb_is_leaf(child) ? grown : grown - aabb_cost(child->box));
+        }
+
+        if (cost < costs[0] && cost < costs[1])
+            break;
+        index = costs[0] <= costs[1] ? children[0] : children[1];
+    }
+
+    int32_t sibling = index;
+    int32_t parent = aabb_alloc(tree);
+    if (parent == AABB_NULL)
+        return false;
+
+    // The array may have moved.
+    AABBNode *nodes = tree->nodes;
+    int32_t old_parent = nodes[sibling].parent;
+    nodes[parent].parent = old_parent;
+    nodes[parent].box = aabb_union(box, nodes[sibling].box);
+    nodes[parent].height = nodes[sibling].height + 1;
+    nodes[parent].left = sibling;
+    nodes[parent].right = leaf;
+    aabb_replace_child(tree, old_parent, sibling, parent);
+    nodes[sibling].parent = parent;
+    nodes[leaf].parent = parent;
+
+    aabb_refit(tree, old_parent);
+    return true;
+}
+
+/**
+ * Unlink a leaf, its sibling takes the place of their parent.
+ */
+static void aabb_remove_leaf(AABBTree *tree, int32_t leaf)
+{
+    if (leaf == tree->root)
+    {
+        tree->root = AABB_NULL;
+        return;
+    }
+
+    AABBNode *nodes = tree->nodes;
+    int32_t parent = nodes[leaf].parent;
+    int32_t grand = nodes[parent].parent;
+    int32_t sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+    aabb_replace_child(tree, grand, parent, sibling);
+    nodes[sibling].parent = grand;
+    aabb_release(tree, parent);
+    aabb_refit(tree, grand);
+}
+
+/**
+ * Find the leaf of an entity at position, every box on the way holds it.
+ */
+static int32_t aabb_find_leaf(AABBTree *tree, Entity *entity, SDL_Rect position)
+{
+    int32_t found = AABB_NULL;
+    AABBStack stack;
+    aabb_stack_init(&stack, tree);
+
+    while (stack.count > 0)
+    {
+        int32_t index = stack.nodes[--stack.count].node;
+        AABBNode *node = &tree->nodes[index];
+        if (!is_inside(node->box, position))
+            continue;
+
+        if (aabb_is_leaf(node))
+        {
+            if (node->entity != entity)
+                continue;
+            found = index;
+            break;
+        }
+        if (!aabb_stack_push(&stack, node->left, 0) || !aabb_stack_push(&stack, node->right, 0))
+            break;
+    }
+
+    aabb_stack_free(&stack);
+    return found;
+}
+
+// ---------------- Main functions ----------------
+
+/**
+ * Initialize an empty tree with leaves widened by margin.
+ */
+bool aabb_init(AABBTree *tree, int margin)
+{
+    memset(tree, 0, sizeof(AABBTree));
+    tree->root = AABB_NULL;
+    tree->free_list = AABB_NULL;
+    tree->margin = margin > 0 ? margin : 0;
+    return true;
+}
+
+/**
+ * Free the tree.
+ */
+void aabb_free(AABBTree *tree)
+{
+    free(tree->nodes);
+    aabb_init(tree, tree->margin);
+}
+
+/**
+ * Take every entity out of the tree.
+ */
+void aabb_clear(AABBTree *tree)
+{
+    // Chain every node back onto the free list.
+    for (int32_t i = 0; i < tree->node_maximum; i++)
+    {
+        tree->nodes[i].parent = i + 1 < tree->node_maximum ? i + 1 : AABB_NULL;
+        tree->nodes[i].height = -1;
+    }
+    tree->free_list = tree->node_maximum ? 0 : AABB_NULL;
+    tree->root = AABB_NULL;
+    tree->node_count = 0;
+    tree->count = 0;
+}
+
+/**
+ * Insert an entity into the tree.
+ */
+bool aabb_insert(AABBTree *tree, Entity *entity)
+{
+    int32_t leaf = aabb_alloc(tree);
+    if (leaf == AABB_NULL)
+        return false;
+
+    SDL_Rect position = entity->position;
+    tree->nodes[leaf].box = (SDL_Rect){.x = position.x - tree->margin,
+                                       .y = position.y - tree->margin,
+                                       .w = position.w + 2 * tree->margin,
+                                       .h = position.h + 2 * tree->margin};
+    tree->nodes[leaf].entity = entity;
+    if (!aabb_insert_leaf(tree, leaf))
+    {
+        aabb_release(tree, leaf);
+        return false;
+    }
+    tree->count++;
+    return true;
+}
+
+/**
+ * Remove an entity from the tree, it must not have moved since it was
+ * inserted or last updated.
+ */
+bool aabb_remove(AABBTree *tree, Entity *entity)
+{
+    int32_t leaf = aabb_find_leaf(tree, entity, entity->position);
+    if (leaf == AABB_NULL)
+        return false;
+
+    aabb_remove_leaf(tree, leaf);
+    aabb_release(tree, leaf);
+    tree->count--;
+    return true;
+}
+
+/**
+ * Move an entity whose position has changed from old_position, nothing is
+ * done while it stays inside its widened box.
+ */
+bool aabb_update(AABBTree *tree, Entity *entity, SDL_Rect old_position)
+{
+    int32_t leaf = aabb_find_leaf(tree, entity, old_position);
+    if (leaf == AABB_NULL)
+        return false;
+    if (is_inside(tree->nodes[leaf].box, entity->position))
+        return true;
+
+    // Refit the path it leaves and the one it joins, the leaf itself is reused.
+    aabb_remove_leaf(tree, leaf);
+    SDL_Rect position = entity->position;
+    tree->nodes[leaf].box = (SDL_Rect){.x = position.x - tree->margin,
+                                       .y = position.y - tree->margin,
+                                       .w = position.w + 2 * tree->margin,
+                                       .h = position.h + 2 * tree->margin};
+    if (aabb_insert_leaf(tree, leaf))
+        return true;
+
+    aabb_release(tree, leaf);
+    tree->count--;
+    return false;
+}
+
+/**
+ * Visit every entity overlapping rect, returns the number visited.
+ */
+size_t aabb_visit_rect(AABBTree *tree, SDL_Rect rect, QuadVisitor visit, void *data)
+{
+    size_t count = 0;
+    AABBStack stack;
+    aabb_stack_init(&stack, tree);
+
+    while (stack.count > 0)
+    {
+        AABBNode *node = &tree->nodes[stack.nodes[--stack.count].node];
+        if (!is_overlap(rect, node->box))
+            continue;
+
+        if (aabb_is_leaf(node))
+        {
+            if (!is_overlap(rect, node->entity->position))
+                continue;
+            count++;
+            if (!visit(node->entity, data))
+                break;
+            continue;
+        }
+        if (!aabb_stack_push(&stack, node->right, 0) || !aabb_stack_push(&stack, node->left, 0))
+            break;
+    }
+
+    aabb_stack_free(&stack);
+    return count;
+}
+
+/**
+ * Returns an entity under the centre of point, or NULL if there is none.
+ */
+Entity *aabb_find_entity(AABBTree *tree, SDL_Rect point)
+{
+    SDL_Point p = get_rect_centre(point);
+    Entity *found = NULL;
+    AABBStack stack;
+    aabb_stack_init(&stack, tree);
+
+    while (stack.count > 0)
+    {
+        AABBNode *node = &tree->nodes[stack.nodes[--stack.count].node];
+        if (!is_collision(p.x, p.y, node->box))
+            continue;
+
+        if (aabb_is_leaf(node))
+        {
+            if (!is_collision(p.x, p.y, node->entity->position))
+                continue;
+            found = node->entity;
+            break;
+        }
+        if (!aabb_stack_push(&stack, node->right, 0) || !aabb_stack_push(&stack, node->left, 0))
+            break;
+    }
+
+    aabb_stack_free(&stack);
+    return found;
+}
+
+/**
+ * Collect the k entities whose centres are closest to point, nearest first.
+ * Returns the number written to found.
+ */
+size_t aabb_query_knn(AABBTree *tree, SDL_Point point, size_t k, Entity **found)
+{
+    if (k == 0 || tree->count == 0)
+        return 0;
+    if (k > tree->count)
+        k = tree->count;
+
+    QuadNearest nearest;
+    if (!quad_nearest_init(&nearest, k))
+        return 0;
+
+    AABBStack stack;
+    aabb_stack_init(&stack, tree);
+    while (stack.count > 0)
+    {
+        AABBPending pending = stack.nodes[--stack.count];
+        // Its box is further than the furthest we are keeping.
+        if (!quad_nearest_wants(&nearest, pending.distance))
+            continue;
+
+        AABBNode *node = &tree->nodes[pending.node];
+        if (aabb_is_leaf(node))
+        {
+            quad_nearest_offer(&nearest, node->entity,
+                               quad_distance_to_centre(node->entity->position, point));
+            continue;
+        }
+
+        // The nearer child is pushed last so it is searched first.
+        SDL_Rect left_box = tree->nodes[node->left].box;
+        SDL_Rect right_box = tree->nodes[node->right].box;
+        AABBPending left = {.node = node->left, .distance = quad_distance_to_rect(left_box, point)};
+        AABBPending right = {.node = node->right,
+                             .distance = quad_distance_to_rect(right_box, point)};
+        AABBPending further = left.distance < right.distance ? right : left;
+        AABBPending nearer = left.distance < right.distance ? left : right;
+        if (!aabb_stack_push(&stack, further.node, further.distance) ||
+            !aabb_stack_push(&stack, nearer.node, nearer.distance))
+            break;
+    }
+
+    aabb_stack_free(&stack);
+    return quad_nearest_finish(&nearest, found);
+}
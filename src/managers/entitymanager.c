@@ -5,7 +5,7 @@
 #include "../../include/game.h"
 #include "../../include/entities/entity.h"
 #include "../../include/managers/entitymanager.h"
-#include "../../include/managers/quadtree.h"
+#include "../../include/managers/spatialindex.h"
 
 /**
  * Create new entity manager.
@@ -38,9 +38,8 @@ void add_entity(EntityManager *entityManager, Entity *(*init_entity)(void), SDL_
     // Set the width and height.
     entityManager->entities[entityManager->current]->position = rect;
 
-    // Insert into the spacial tree.
-    quad_insert_entity(gameData.scene->spacial.root,
-                       entityManager->entities[entityManager->current]);
+    // Insert into the spacial index, along with the rest of the frame if batching.
+    spatial_insert(&gameData.scene->spacial, entityManager->entities[entityManager->current]);
     entityManager->current++;
 }
 
@@ -49,6 +48,14 @@ void add_entity(EntityManager *entityManager, Entity *(*init_entity)(void), SDL_
  */
 void clean_entities(EntityManager *entityManager)
 {
+    // Take them out of the spacial index before they are freed.
+    for (int i = 0; i < entityManager->current; i++)
+    {
+        if (entityManager->entities[i]->remove)
+            spatial_remove(&gameData.scene->spacial, entityManager->entities[i]);
+    }
+    spatial_commit(&gameData.scene->spacial);
+
     for (int i = 0; i < entityManager->current; i++)
     {
         // Does this entity need to be removed?
@@ -7,9 +7,49 @@
 #include "../../include/game.h"
 #include "../../include/util/camera.h"
 #include "../../include/managers/eventmanager.h"
+#include "../../include/managers/spatialindex.h"
 #include "../../include/entities/entity.h"
 #include "../../include/components/move.h"
 
+/**
+ * An entity with a component being searched for under a point.
+ */
+typedef struct PointSearch
+{
+    SDL_Point point;
+    // COMPONENT_TOTAL accepts any entity.
+    ComponentType component;
+    Entity *found;
+} PointSearch;
+
+/**
+ * Stop at the first entity with the component that collides with the point.
+ */
+static bool find_component(Entity *e, void *data)
+{
+    PointSearch *search = (PointSearch *)data;
+    if ((search->component != COMPONENT_TOTAL && !has_component(e, search->component)) ||
+        !is_collision(search->point.x, search->point.y, e->position))
+        return true;
+
+    search->found = e;
+    return false;
+}
+
+/**
+ * Find an entity with the component at x and y through the spacial index,
+ * any entity if the component is COMPONENT_TOTAL.
+ */
+static Entity *entity_at(GameData *gameData, int x, int y, ComponentType component)
+{
+    PointSearch search = {.point = {x, y}, .component = component, .found = NULL};
+    // Grown by a pixel so entities touching the point on their far edge are found.
+    spatial_query_rect(&gameData->currentScene->spacial,
+                       (SDL_Rect){.x = x - 1, .y = y - 1, .w = 2, .h = 2}, &find_component,
+                       &search);
+    return search.found;
+}
+
 /**
  * Default handler for clicks.
  * Handles: left clicks, right clicks, and click and drags.
@@ -26,57 +66,25 @@ static void click_handler(GameData *gameData)
         {
             DEBUG_LOG("Mouse left clicked and dragged!\n");
             // Being dragged
-            for (int i = 0; i < gameData->currentScene->entities.current; i++)
-            {
-                Entity *e = gameData->currentScene->entities.entities[i];
-                // Can entity even be clicked?
-                if (!has_component(e, Dragged))
-                {
-                    continue;
-                }
-                // Check if entity has been clicked.
-                if (is_collision(x, y, e->position))
-                {
-                    // Call entity's clicked function.
-                    e->components[Dragged].call(e, x, y);
-                    return;
-                }
-            }
+            Entity *e = entity_at(gameData, x, y, Dragged);
+            // Call entity's clicked function.
+            if (e)
+                e->components[Dragged].call(e, x, y);
         }
         else
         {
-            for (int i = 0; i < gameData->currentScene->entities.current; i++)
-            {
-                Entity *e = gameData->currentScene->entities.entities[i];
-                if (!has_component(e, LeftClicked))
-                {
-                    continue;
-                }
-                if (is_collision(x, y, e->position))
-                {
-                    e->components[LeftClicked].call(e);
-                    return;
-                }
-            }
+            Entity *e = entity_at(gameData, x, y, LeftClicked);
+            if (e)
+                e->components[LeftClicked].call(e);
         }
     }
     else if (gameData->event.button.button == SDL_BUTTON_RIGHT)
     {
-        for (int i = 0; i < gameData->currentScene->entities.current; i++)
-        {
-            Entity *e = gameData->currentScene->entities.entities[i];
-            // Can entity even be clicked?
-            if (!has_component(e, RightClicked))
-                continue;
-
-            // Check if entity has been clicked.
-            if (is_collision(x, y, e->position))
-            {
-                // Call entity's clicked function.
-                e->components[RightClicked].call(e);
-                return;
-            }
-        }
+        // Check if an entity that can be clicked has been clicked.
+        Entity *e = entity_at(gameData, x, y, RightClicked);
+        // Call entity's clicked function.
+        if (e)
+            e->components[RightClicked].call(e);
     }
 }
 
@@ -102,16 +110,9 @@ static void key_handler(GameData *gameData)
     case SDLK_DELETE:
         // If hovering over an entity delete it.
         SDL_GetMouseState(&x, &y);
-        for (int i = 0; i < gameData->currentScene->entities.current; i++)
-        {
-            Entity *e = gameData->currentScene->entities.entities[i];
-            if (is_collision(x, y, e->position))
-            {
-                // Call entity's clicked function.
-                e->components[Deleted].call(e);
-                return;
-            }
-        }
+        Entity *e = entity_at(gameData, x, y, COMPONENT_TOTAL);
+        if (e)
+            e->components[Deleted].call(e);
         break;
     default:
         break;
@@ -0,0 +1,539 @@
+#include <SDL2/SDL.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "../../include/debug.h"
+#include "../../include/managers/linearquadtree.h"
+#include "../../include/managers/quadsearch.h"
+#include "../../include/entities/entity.h"
+#include "../../include/util/camera.h"
+
+/*****************************************************************************
+ * A pointerless quad tree, entities are kept sorted by the Morton code of   *
+ * their centre and a leaf is the range of codes under a quadrent that holds *
+ * no more than capacity entities.                                           *
+ *****************************************************************************/
+
+// Levels of the 65536 x 65536 grid behind the Morton codes.
+#define LQUAD_DEPTH 16
+// Quadrents a search can have waiting at once, each level leaves three behind.
+#define LQUAD_STACK (LQUAD_DEPTH * (QUADRENTS - 1) + QUADRENTS)
+
+/**
+ * A quadrent waiting to be searched and the range of entities under it.
+ */
+typedef struct LQuadCell
+{
+    uint32_t start;
+    int depth;
+    uint32_t lo;
+    uint32_t hi;
+} LQuadCell;
+
+/**
+ * Entities overlapping a rect, passed on to the caller's visitor.
+ */
+typedef struct LQuadOverlap
+{
+    SDL_Rect rect;
+    QuadVisitor visit;
+    void *data;
+    size_t count;
+} LQuadOverlap;
+
+/**
+ * The first entity found under a point.
+ */
+typedef struct LQuadPick
+{
+    SDL_Point point;
+    Entity *found;
+} LQuadPick;
+
+// ---------------- Helper functions ----------------
+
+/**
+ * Gather every other bit of value into the lower 16 bits.
+ */
+static uint32_t compact_bits(uint32_t value)
+{
+    value &= 0x55555555;
+    value = (value | (value >> 1)) & 0x33333333;
+    value = (value | (value >> 2)) & 0x0F0F0F0F;
+    value = (value | (value >> 4)) & 0x00FF00FF;
+    value = (value | (value >> 8)) & 0x0000FFFF;
+    return value;
+}
+
+/**
+ * Index of the first code in [lo, hi) that is not less than key.
+ */
+static uint32_t lquad_lower_bound(LinearQuadTree *quad, uint32_t lo, uint32_t hi, uint64_t key)
+{
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (quad->codes[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * The area of the bounds a quadrent covers, rounded outwards so every centre
+ * coded into it lies inside.
+ */
+static SDL_Rect lquad_cell_rect(LinearQuadTree *quad, LQuadCell cell)
+{
+    int64_t size = (int64_t)1 << (LQUAD_DEPTH - cell.depth);
+    int64_t x = compact_bits(cell.start);
+    int64_t y = compact_bits(cell.start >> 1);
+    int64_t x0 = (x * quad->bounds.w) >> 16;
+    int64_t y0 = (y * quad->bounds.h) >> 16;
+    int64_t x1 = ((x + size) * quad->bounds.w + 0xFFFF) >> 16;
+    int64_t y1 = ((y + size) * quad->bounds.h + 0xFFFF) >> 16;
+    return (SDL_Rect){.x = quad->bounds.x + (int)x0,
+                      .y = quad->bounds.y + (int)y0,
+                      .w = (int)(x1 - x0),
+                      .h = (int)(y1 - y0)};
+}
+
+/**
+ * Split the range of a quadrent between its children, in quadrent order.
+ */
+static void lquad_split(LinearQuadTree *quad, LQuadCell cell, LQuadCell children[QUADRENTS])
+{
+    int shift = 2 * (LQUAD_DEPTH - cell.depth - 1);
+    uint32_t lo = cell.lo;
+    for (Quadrent q = 0; q < QUADRENTS; q++)
+    {
+        uint32_t start = cell.start + ((uint32_t)q << shift);
+        uint64_t next = (uint64_t)start + ((uint64_t)1 << shift);
+        uint32_t end = lquad_lower_bound(quad, lo, cell.hi, next);
+        children[q] = (LQuadCell){.start = start, .depth = cell.depth + 1, .lo = lo, .hi = end};
+        lo = end;
+    }
+}
+
+/**
+ * Widen how far entities reach past their centre to cover position.
+ */
+static inline void lquad_widen_reach(LinearQuadTree *quad, SDL_Rect position)
+{
+    // The centre rounds down, so the right and bottom reach further.
+    int reach = SDL_max(position.w - position.w / 2, position.h - position.h / 2);
+    if (reach > quad->reach)
+        quad->reach = reach;
+}
+
+/**
+ * Visit every entity whose centre could be close enough to overlap area,
+ * in code order and then those outside of the bounds. Returns false if the
+ * visitor stopped.
+ */
+static bool lquad_visit_near(LinearQuadTree *quad, SDL_Rect area, QuadVisitor visit, void *data)
+{
+    // Corners of the area on the grid, grown by how far an entity can reach.
+    SDL_Rect grown = quad_inflate(area, quad->reach);
+    uint32_t low = get_morton_code(quad->bounds, (SDL_Point){grown.x, grown.y});
+    uint32_t high =
+        get_morton_code(quad->bounds, (SDL_Point){grown.x + grown.w, grown.y + grown.h});
+    uint32_t x0 = compact_bits(low), y0 = compact_bits(low >> 1);
+    uint32_t x1 = compact_bits(high), y1 = compact_bits(high >> 1);
+
+    LQuadCell stack[LQUAD_STACK];
+    int top = 0;
+    stack[0] = (LQuadCell){.start = 0, .depth = 0, .lo = 0, .hi = quad->count};
+    while (top >= 0)
+    {
+        LQuadCell cell = stack[top--];
+        if (cell.lo == cell.hi)
+            continue;
+
+        // Where is this quadrent on the grid?
+        uint32_t size = 1u << (LQUAD_DEPTH - cell.depth);
+        uint32_t x = compact_bits(cell.start);
+        uint32_t y = compact_bits(cell.start >> 1);
+        if (x > x1 || x + size - 1 < x0 || y > y1 || y + size - 1 < y0)
+            continue;
+
+        // Check the entities directly once there is nothing left to prune.
+        bool covered = x >= x0 && x + size - 1 <= x1 && y >= y0 && y + size - 1 <= y1;
+        if (covered || cell.hi - cell.lo <= quad->capacity || cell.depth == LQUAD_DEPTH)
+        {
+            for (uint32_t i = cell.lo; i < cell.hi; i++)
+            {
+                if (!visit(quad->entities[i], data))
+                    return false;
+            }
+            continue;
+        }
+
+        // Pushed backwards so they come off in quadrent order.
+        LQuadCell children[QUADRENTS];
+        lquad_split(quad, cell, children);
+        for (int q = QUADRENTS - 1; q >= 0; q--)
+            stack[++top] = children[q];
+    }
+
+    for (uint32_t i = 0; i < quad->outside_count; i++)
+    {
+        if (!visit(quad->outside[i], data))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Pass entities overlapping the rect on to the caller's visitor.
+ */
+static bool lquad_visit_overlap(Entity *entity, void *data)
+{
+    LQuadOverlap *overlap = (LQuadOverlap *)data;
+    if (!is_overlap(overlap->rect, entity->position))
+        return true;
+
+    overlap->count++;
+    return overlap->visit(entity, overlap->data);
+}
+
+/**
+ * Stop at the first entity under the point.
+ */
+static bool lquad_visit_pick(Entity *entity, void *data)
+{
+    LQuadPick *pick = (LQuadPick *)data;
+    if (!is_collision(pick->point.x, pick->point.y, entity->position))
+        return true;
+
+    pick->found = entity;
+    return false;
+}
+
+/**
+ * Find where an entity placed by its centre at point is stored, in the
+ * sorted arrays or, if outside is set, in the list outside of the bounds.
+ * Returns false if it is not stored.
+ */
+static bool lquad_locate(LinearQuadTree *quad, Entity *entity, SDL_Point point, uint32_t *index,
+                         bool *outside)
+{
+    *outside = !is_point_inside(quad->bounds, point);
+    if (*outside)
+    {
+        for (uint32_t i = 0; i < quad->outside_count; i++)
+        {
+            if (quad->outside[i] == entity)
+            {
+                *index = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Only entities sharing its code need checking.
+    uint32_t code = get_morton_code(quad->bounds, point);
+    uint32_t hi = lquad_lower_bound(quad, 0, quad->count, (uint64_t)code + 1);
+    for (uint32_t i = lquad_lower_bound(quad, 0, hi, code); i < hi; i++)
+    {
+        if (quad->entities[i] == entity)
+        {
+            *index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Take the entity at index out of the sorted arrays, or out of the list
+ * outside of the bounds if outside is set.
+ */
+static void lquad_take(LinearQuadTree *quad, uint32_t index, bool outside)
+{
+    if (outside)
+    {
+        // Order does not matter out here.
+        quad->outside[index] = quad->outside[--quad->outside_count];
+        return;
+    }
+
+    // Shift everything after it back by one.
+    quad->count--;
+    memmove(quad->codes + index, quad->codes + index + 1,
+            sizeof(uint32_t) * (quad->count - index));
+    memmove(quad->entities + index, quad->entities + index + 1,
+            sizeof(Entity *) * (quad->count - index));
+}
+
+/**
+ * Add an entity whose centre is outside of the bounds to the outside list.
+ */
+static bool lquad_push_outside(LinearQuadTree *quad, Entity *entity)
+{
+    if (quad->outside_count == quad->outside_maximum)
+    {
+        uint32_t maximum = quad->outside_maximum ? quad->outside_maximum * 2 : 16;
+        Entity **outside = (Entity **)realloc(quad->outside, sizeof(Entity *) * maximum);
+        if (!outside)
+        {
+            ERROR_LOG("Unable to grow the entities outside of the linear quad tree!\n");
+            return false;
+        }
+        quad->outside = outside;
+        quad->outside_maximum = maximum;
+    }
+
+    quad->outside[quad->outside_count++] = entity;
+    return true;
+}
+
+// ---------------- Main functions ----------------
+
+/**
+ * Initialize the linear quad tree with leaves holding up to capacity entities.
+ */
+bool lquad_init_tree(LinearQuadTree *quad, SDL_Rect bounds, uint16_t capacity)
+{
+    quad->bounds = bounds;
+    quad->capacity = capacity > 0 ? capacity : 1;
+    quad->count = 0;
+    quad->maximum = 16;
+    quad->outside = NULL;
+    quad->outside_count = 0;
+    quad->outside_maximum = 0;
+    quad->reach = 0;
+    quad->codes = (uint32_t *)malloc(sizeof(uint32_t) * quad->maximum);
+    quad->entities = (Entity **)malloc(sizeof(Entity *) * quad->maximum);
+    if (!quad->codes || !quad->entities)
+    {
+        ERROR_LOG("Unable to allocate the linear quad tree!\n");
+        lquad_free_tree(quad);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Free linear quad tree.
+ */
+void lquad_free_tree(LinearQuadTree *quad)
+{
+    free(quad->codes);
+    free(quad->entities);
+    free(quad->outside);
+    quad->codes = NULL;
+    quad->entities = NULL;
+    quad->outside = NULL;
+    quad->count = 0;
+    quad->maximum = 0;
+    quad->outside_count = 0;
+    quad->outside_maximum = 0;
+}
+
+/**
+ * Take every entity out of the linear quad tree.
+ */
+void lquad_clear(LinearQuadTree *quad)
+{
+    quad->count = 0;
+    quad->outside_count = 0;
+    quad->reach = 0;
+}
+
+/**
+ * Returns the pointer to the stored entity under the centre of point on
+ * success, and NULL if no entity was found.
+ */
+Entity *lquad_find_entity(LinearQuadTree *quad, SDL_Rect point)
+{
+    LQuadPick pick = {.point = get_rect_centre(point), .found = NULL};
+    lquad_visit_near(quad, (SDL_Rect){.x = pick.point.x, .y = pick.point.y, .w = 0, .h = 0},
+                     &lquad_visit_pick, &pick);
+    return pick.found;
+}
+
+/**
+ * Visit every entity overlapping rect, returns the number visited.
+ */
+size_t lquad_visit_rect(LinearQuadTree *quad, SDL_Rect rect, QuadVisitor visit, void *data)
+{
+    LQuadOverlap overlap = {.rect = rect, .visit = visit, .data = data, .count = 0};
+    lquad_visit_near(quad, rect, &lquad_visit_overlap, &overlap);
+    return overlap.count;
+}
+
+/**
+ * Collect up to maximum entities overlapping rect, returns the number written
+ * to found.
+ */
+size_t lquad_query_rect(LinearQuadTree *quad, SDL_Rect rect, Entity **found, size_t maximum)
+{
+    if (maximum == 0)
+        return 0;
+
+    QuadBuffer buffer = {.found = found, .count = 0, .maximum = maximum};
+    lquad_visit_rect(quad, rect, &quad_buffer_entity, &buffer);
+    return buffer.count;
+}
+
+/**
+ * Collect the k entities whose centres are closest to point, nearest first.
+ * Returns the number written to found.
+ */
+size_t lquad_query_knn(LinearQuadTree *quad, SDL_Point point, size_t k, Entity **found)
+{
+    size_t total = (size_t)quad->count + quad->outside_count;
+    if (k == 0 || total == 0)
+        return 0;
+    if (k > total)
+        k = total;
+
+    QuadNearest nearest;
+    if (!quad_nearest_init(&nearest, k))
+        return 0;
+
+    for (uint32_t i = 0; i < quad->outside_count; i++)
+        quad_nearest_offer(&nearest, quad->outside[i],
+                           quad_distance_to_centre(quad->outside[i]->position, point));
+
+    // Depth first, nearest quadrent first, leaving out any that can not
+    // hold a centre closer than the furthest kept.
+    LQuadCell stack[LQUAD_STACK];
+    int top = 0;
+    stack[0] = (LQuadCell){.start = 0, .depth = 0, .lo = 0, .hi = quad->count};
+    while (top >= 0)
+    {
+        LQuadCell cell = stack[top--];
+        if (cell.lo == cell.hi ||
+            !quad_nearest_wants(&nearest,
+                                quad_distance_to_rect(lquad_cell_rect(quad, cell), point)))
+            continue;
+
+        if (cell.hi - cell.lo <= quad->capacity || cell.depth == LQUAD_DEPTH)
+        {
+            for (uint32_t i = cell.lo; i < cell.hi; i++)
+                quad_nearest_offer(&nearest, quad->entities[i],
+                                   quad_distance_to_centre(quad->entities[i]->position, point));
+            continue;
+        }
+
+        // Order the children furthest first, so the nearest comes off next.
+        LQuadCell children[QUADRENTS];
+        int64_t distances[QUADRENTS];
+        lquad_split(quad, cell, children);
+        for (int q = 0; q < QUADRENTS; q++)
+        {
+            LQuadCell child = children[q];
+            int64_t distance = quad_distance_to_rect(lquad_cell_rect(quad, child), point);
+            int i = q;
+            for (; i > 0 && distances[i - 1] < distance; i--)
+            {
+                children[i] = children[i - 1];
+                distances[i] = distances[i - 1];
+            }
+            children[i] = child;
+            distances[i] = distance;
+        }
+        for (int q = 0; q < QUADRENTS; q++)
+            stack[++top] = children[q];
+    }
+
+    return quad_nearest_finish(&nearest, found);
+}
+
+/**
+ * Insert an entity into the linear quad tree.
+ */
+bool lquad_insert_entity(LinearQuadTree *quad, Entity *entity)
+{
+    SDL_Point point = get_rect_centre(entity->position);
+    if (!is_point_inside(quad->bounds, point))
+        return lquad_push_outside(quad, entity);
+
+    // Check if we have any space left for a new entity.
+    if (quad->count == quad->maximum)
+    {
+        uint32_t *codes = (uint32_t *)realloc(quad->codes, sizeof(uint32_t) * quad->maximum * 2);
+        if (codes)
+            quad->codes = codes;
+        Entity **entities =
+            (Entity **)realloc(quad->entities, sizeof(Entity *) * quad->maximum * 2);
+        if (entities)
+            quad->entities = entities;
+        if (!codes || !entities)
+        {
+            ERROR_LOG("Unable to grow the linear quad tree!\n");
+            return false;
+        }
+        quad->maximum *= 2;
+    }
+
+    // Shift everything after our code along by one.
+    uint32_t code = get_morton_code(quad->bounds, point);
+    uint32_t i = lquad_lower_bound(quad, 0, quad->count, (uint64_t)code + 1);
+    memmove(quad->codes + i + 1, quad->codes + i, sizeof(uint32_t) * (quad->count - i));
+    memmove(quad->entities + i + 1, quad->entities + i, sizeof(Entity *) * (quad->count - i));
+    quad->codes[i] = code;
+    quad->entities[i] = entity;
+    quad->count++;
+    lquad_widen_reach(quad, entity->position);
+    return true;
+}
+
+/**
+ * Remove the entity under the centre of point from the linear quad tree.
+ */
+bool lquad_remove_entity(LinearQuadTree *quad, SDL_Rect point)
+{
+    Entity *entity = lquad_find_entity(quad, point);
+    if (!entity || !lquad_detach_entity(quad, entity))
+        return false;
+
+    // Mark the entity for cleanup.
+    entity->remove = true;
+    return true;
+}
+
+/**
+ * Take an entity out of the linear quad tree without marking it for cleanup,
+ * it must not have moved since it was inserted or last updated.
+ */
+bool lquad_detach_entity(LinearQuadTree *quad, Entity *entity)
+{
+    uint32_t index;
+    bool outside;
+    if (!lquad_locate(quad, entity, get_rect_centre(entity->position), &index, &outside))
+        return false;
+
+    lquad_take(quad, index, outside);
+    return true;
+}
+
+/**
+ * Move an entity whose position has changed from old_position.
+ */
+bool lquad_update_entity(LinearQuadTree *quad, Entity *entity, SDL_Rect old_position)
+{
+    uint32_t index;
+    bool outside;
+    if (!lquad_locate(quad, entity, get_rect_centre(old_position), &index, &outside))
+        return false;
+
+    // Still under the same code, only the reach can have changed.
+    SDL_Point to = get_rect_centre(entity->position);
+    bool inside = is_point_inside(quad->bounds, to);
+    if (outside ? !inside : inside && get_morton_code(quad->bounds, to) == quad->codes[index])
+    {
+        lquad_widen_reach(quad, entity->position);
+        return true;
+    }
+
+    lquad_take(quad, index, outside);
+    return lquad_insert_entity(quad, entity);
+}
@@ -0,0 +1,337 @@
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef UNIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef WIN
+#include <windows.h>
+#endif
+
+#include "../../include/debug.h"
+#include "../../include/managers/quadfile.h"
+#include "../../include/managers/quadsearch.h"
+#include "../../include/managers/quadsnapshot.h"
+#include "../../include/managers/quadtree.h"
+#include "../../include/util/camera.h"
+
+/**
+ * An entity and its index in the array being saved.
+ */
+typedef struct QuadFileIndex
+{
+    Entity *entity;
+    uint32_t index;
+} QuadFileIndex;
+
+// ---------------- Helper functions ----------------
+
+/**
+ * Order entity indices by address for a binary search.
+ */
+static int quad_compare_indices(const void *a, const void *b)
+{
+    const Entity *x = ((const QuadFileIndex *)a)->entity;
+    const Entity *y = ((const QuadFileIndex *)b)->entity;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Write the flattened tree to an open file, entries as their indices.
+ */
+static bool quad_write_snapshot(FILE *file, QuadTree *quad, const QuadSnapshot *snapshot,
+                                const QuadFileIndex *indices, size_t count)
+{
+    QuadFileHeader header = {
+        .magic = QUAD_FILE_MAGIC,
+        .version = QUAD_FILE_VERSION,
+        .byte_order = 1,
+        .capacity = quad->capacity,
+        .reserved = 0,
+        .looseness = quad->looseness,
+        .margin = snapshot->margin,
+        .node_count = snapshot->node_count,
+        .entry_count = snapshot->entry_count,
+        .entity_count = (uint32_t)count,
+        .nodes = sizeof(QuadFileHeader),
+        .entries = sizeof(QuadFileHeader) + sizeof(QuadSnapNode) * (uint64_t)snapshot->node_count,
+    };
+    if (fwrite(&header, sizeof(QuadFileHeader), 1, file) != 1 ||
+        fwrite(snapshot->nodes, sizeof(QuadSnapNode), snapshot->node_count, file) !=
+            snapshot->node_count)
+        return false;
+
+    for (uint32_t i = 0; i < snapshot->entry_count; i++)
+    {
+        QuadFileIndex key = {.entity = snapshot->entries[i].entity};
+        const QuadFileIndex *found = (const QuadFileIndex *)bsearch(
+            &key, indices, count, sizeof(QuadFileIndex), &quad_compare_indices);
+        if (!found)
+        {
+            ERROR_LOG("Entity in the tree is not in the array being saved!\n");
+            return false;
+        }
+
+        QuadFileEntry entry = {.index = found->index, .position = snapshot->entries[i].position};
+        if (fwrite(&entry, sizeof(QuadFileEntry), 1, file) != 1)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Check the mapping holds a tree this build can read and point into it.
+ */
+static bool quad_open_map(QuadMap *map)
+{
+    if (map->size < sizeof(QuadFileHeader))
+        return false;
+
+    const QuadFileHeader *header = (const QuadFileHeader *)map->base;
+    if (header->magic != QUAD_FILE_MAGIC || header->version != QUAD_FILE_VERSION ||
+        header->byte_order != 1 || header->node_count == 0 || header->margin < 0)
+        return false;
+
+    // Both arrays must lie inside the file and be aligned for reading in place.
+    uint64_t nodes_end = header->nodes + sizeof(QuadSnapNode) * (uint64_t)header->node_count;
+    uint64_t entries_end = header->entries + sizeof(QuadFileEntry) * (uint64_t)header->entry_count;
+    if (header->nodes % _Alignof(QuadSnapNode) || header->entries % _Alignof(QuadFileEntry) ||
+        nodes_end > map->size || entries_end > map->size || nodes_end < header->nodes ||
+        entries_end < header->entries)
+        return false;
+
+    // Callers index their entity arrays with the entries, so each must fit.
+    const QuadFileEntry *entries =
+        (const QuadFileEntry *)((const char *)map->base + header->entries);
+    for (uint32_t i = 0; i < header->entry_count; i++)
+    {
+        if (entries[i].index >= header->entity_count)
+            return false;
+    }
+
+    map->header = header;
+    map->nodes = (const QuadSnapNode *)((const char *)map->base + header->nodes);
+    map->entries = entries;
+    return true;
+}
+
+/**
+ * One past the last entry of a mapped node, no entries if a damaged file
+ * points outside them.
+ */
+static inline uint32_t quad_map_entries_end(const QuadMap *map, const QuadSnapNode *node)
+{
+    uint32_t entries = map->header->entry_count;
+    if (node->first > entries || node->count > entries - node->first)
+        return node->first;
+    return node->first + node->count;
+}
+
+// ---------------- Main functions ----------------
+
+/**
+ * Save the tree to path, every entity it holds must be in entities and is
+ * written as its index there. Returns false on failure.
+ */
+bool quad_save_tree(QuadTree *quad, const char *path, Entity **entities, size_t count)
+{
+    if (count > UINT32_MAX)
+    {
+        ERROR_LOG("Can not save more than %u entities!\n", UINT32_MAX);
+        return false;
+    }
+
+    // Entities are looked up by address to find their index.
+    QuadFileIndex *indices = (QuadFileIndex *)malloc(sizeof(QuadFileIndex) * (count ? count : 1));
+    if (!indices)
+    {
+        ERROR_LOG("Unable to allocate indices for %zu entities!\n", count);
+        return false;
+    }
+    for (size_t i = 0; i < count; i++)
+        indices[i] = (QuadFileIndex){.entity = entities[i], .index = (uint32_t)i};
+    qsort(indices, count, sizeof(QuadFileIndex), &quad_compare_indices);
+
+    // A snapshot is already flat and pointer free apart from its entities.
+    QuadSnapshots snapshots;
+    quad_init_snapshots(&snapshots);
+    bool saved = false;
+    if (quad_publish_snapshot(&snapshots, quad))
+    {
+        FILE *file = fopen(path, "wb");
+        if (file)
+        {
+            const QuadSnapshot *snapshot = quad_acquire_snapshot(&snapshots);
+            saved = quad_write_snapshot(file, quad, snapshot, indices, count);
+            quad_release_snapshot(snapshot);
+            saved = fclose(file) == 0 && saved;
+        }
+        if (!saved)
+            ERROR_LOG("Unable to save the tree to %s!\n", path);
+    }
+
+    quad_free_snapshots(&snapshots);
+    free(indices);
+    return saved;
+}
+
+/**
+ * Map a tree saved by quad_save_tree, the file is read lazily as it is
+ * queried. Returns false if it can not be mapped or is not a saved tree.
+ */
+bool quad_map_tree(QuadMap *map, const char *path)
+{
+    memset(map, 0, sizeof(QuadMap));
+
+#ifdef UNIX
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+    {
+        ERROR_LOG("Unable to open %s!\n", path);
+        return false;
+    }
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0)
+    {
+        close(file);
+        ERROR_LOG("Unable to read the size of %s!\n", path);
+        return false;
+    }
+    void *base = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping stays valid once the file is closed.
+    close(file);
+    if (base == MAP_FAILED)
+    {
+        ERROR_LOG("Unable to map %s!\n", path);
+        return false;
+    }
+    map->base = base;
+    map->size = (size_t)info.st_size;
+#endif
+
+#ifdef WIN
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        ERROR_LOG("Unable to open %s!\n", path);
+        return false;
+    }
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    // The mapping object keeps the file open.
+    CloseHandle(file);
+    if (!mapping)
+    {
+        ERROR_LOG("Unable to map %s!\n", path);
+        return false;
+    }
+    void *base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!base)
+    {
+        CloseHandle(mapping);
+        ERROR_LOG("Unable to map %s!\n", path);
+        return false;
+    }
+    map->base = base;
+    map->size = (size_t)size.QuadPart;
+    map->mapping = mapping;
+#endif
+
+    if (!quad_open_map(map))
+    {
+        ERROR_LOG("%s is not a saved tree!\n", path);
+        quad_unmap_tree(map);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Unmap a tree mapped by quad_map_tree.
+ */
+void quad_unmap_tree(QuadMap *map)
+{
+    if (!map->base)
+        return;
+
+#ifdef UNIX
+    munmap(map->base, map->size);
+#endif
+
+#ifdef WIN
+    UnmapViewOfFile(map->base);
+    CloseHandle(map->mapping);
+#endif
+
+    memset(map, 0, sizeof(QuadMap));
+}
+
+/**
+ * Find the index of the entity under the centre of point, returns false if
+ * there was none.
+ */
+bool quad_map_find_entity(const QuadMap *map, SDL_Rect point, uint32_t *index)
+{
+    if (!map->base)
+        return false;
+
+    SDL_Point p = get_rect_centre(point);
+    QuadFlatSearch search;
+    quad_flat_begin(&search, map->nodes, map->header->node_count, map->header->margin);
+
+    const QuadSnapNode *node;
+    while ((node = quad_flat_next_point(&search, p)))
+    {
+        uint32_t end = quad_map_entries_end(map, node);
+        for (uint32_t i = node->first; i < end; i++)
+        {
+            if (is_collision(p.x, p.y, map->entries[i].position))
+            {
+                *index = map->entries[i].index;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Collect the indices of up to maximum entities overlapping rect, returns the
+ * number written to found.
+ */
+size_t quad_map_query_rect(const QuadMap *map, SDL_Rect rect, uint32_t *found, size_t maximum)
+{
+    if (!map->base || maximum == 0)
+        return 0;
+
+    size_t count = 0;
+    QuadFlatSearch search;
+    quad_flat_begin(&search, map->nodes, map->header->node_count, map->header->margin);
+
+    const QuadSnapNode *node;
+    while ((node = quad_flat_next_rect(&search, rect)))
+    {
+        uint32_t end = quad_map_entries_end(map, node);
+        for (uint32_t i = node->first; i < end; i++)
+        {
+            if (!is_overlap(rect, map->entries[i].position))
+                continue;
+            found[count++] = map->entries[i].index;
+            if (count == maximum)
+                return count;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,268 @@
+#include <SDL2/SDL.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "../../include/debug.h"
+#include "../../include/managers/quadjobs.h"
+#include "../../include/managers/quadquery.h"
+#include "../../include/managers/quadtree.h"
+
+// Most threads a query pool will run.
+#define QUAD_MAX_QUERY_WORKERS 64
+
+// ---------------- Helper functions ----------------
+
+/**
+ * Make space for size more results in a worker's buffer.
+ */
+static bool quad_reserve_results(QuadQueryWorker *worker, size_t size)
+{
+    if (worker->count + size <= worker->maximum)
+        return true;
+
+    size_t maximum = worker->maximum ? worker->maximum * 2 : 64;
+    while (maximum < worker->count + size)
+        maximum *= 2;
+
+    Entity **results = (Entity **)realloc(worker->results, sizeof(Entity *) * maximum);
+    if (!results)
+    {
+        ERROR_LOG("Unable to grow query results to %zu entities!\n", maximum);
+        return false;
+    }
+    worker->results = results;
+    worker->maximum = maximum;
+    return true;
+}
+
+/**
+ * Append an entity found by a rect query to a worker's buffer.
+ */
+static bool quad_record_result(Entity *entity, void *data)
+{
+    QuadQueryWorker *worker = (QuadQueryWorker *)data;
+    if (!quad_reserve_results(worker, 1))
+    {
+        worker->failed = true;
+        return false;
+    }
+    worker->results[worker->count++] = entity;
+    return true;
+}
+
+/**
+ * Run a single query, writing its results to the worker's buffer.
+ */
+static void quad_run_query(QuadQueryWorker *worker, QuadTreeNode *node, QuadQuery *query)
+{
+    query->worker = worker->index;
+    query->offset = worker->count;
+
+    switch (query->kind)
+    {
+    case QUAD_QUERY_POINT:
+    {
+        Entity *entity = quad_find_entity(node, query->rect);
+        if (entity)
+            quad_record_result(entity, worker);
+        break;
+    }
+    case QUAD_QUERY_RECT:
+        quad_visit_rect(node, query->rect, &quad_record_result, worker);
+        break;
+    case QUAD_QUERY_KNN:
+        if (!quad_reserve_results(worker, query->k))
+        {
+            worker->failed = true;
+            break;
+        }
+        worker->count += quad_query_knn(node, query->point, query->k,
+                                        worker->results + worker->count);
+        break;
+    }
+
+    query->count = worker->count - query->offset;
+}
+
+/**
+ * Claim and run queries of the current batch until there are none left.
+ */
+static void quad_drain_queries(QuadQueryWorker *worker)
+{
+    QuadQueryPool *pool = worker->pool;
+    for (;;)
+    {
+        size_t next = SDL_AtomicAdd(&pool->next, 1);
+        if (next >= pool->query_count)
+            return;
+        quad_run_query(worker, pool->node, &pool->queries[next]);
+    }
+}
+
+/**
+ * Body of a pool thread, runs its share of each batch until the pool closes.
+ */
+static int quad_query_thread(void *data)
+{
+    QuadQueryWorker *worker = (QuadQueryWorker *)data;
+    QuadQueryPool *pool = worker->pool;
+    uint32_t seen = 0;
+
+    SDL_LockMutex(pool->lock);
+    for (;;)
+    {
+        while (!pool->closing && pool->generation == seen)
+            SDL_CondWait(pool->wake, pool->lock);
+        if (pool->closing)
+            break;
+        seen = pool->generation;
+
+        SDL_UnlockMutex(pool->lock);
+        quad_drain_queries(worker);
+        SDL_LockMutex(pool->lock);
+
+        // The last one out lets the batch return.
+        if (--pool->busy == 0)
+            SDL_CondSignal(pool->done);
+    }
+    SDL_UnlockMutex(pool->lock);
+    return 0;
+}
+
+// ---------------- Main functions ----------------
+
+/**
+ * Start a pool of workers threads, counting the one running each batch, or
+ * one per CPU if workers is 0.
+ */
+bool quad_init_query_pool(QuadQueryPool *pool, int workers)
+{
+    if (workers <= 0)
+        workers = SDL_GetCPUCount();
+    if (workers > QUAD_MAX_QUERY_WORKERS)
+        workers = QUAD_MAX_QUERY_WORKERS;
+    if (workers < 1)
+        workers = 1;
+
+    pool->generation = 0;
+    pool->busy = 0;
+    pool->closing = false;
+    pool->node = NULL;
+    pool->queries = NULL;
+    pool->query_count = 0;
+    SDL_AtomicSet(&pool->next, 0);
+
+    pool->lock = SDL_CreateMutex();
+    pool->wake = SDL_CreateCond();
+    pool->done = SDL_CreateCond();
+    pool->workers = (QuadQueryWorker *)calloc(workers, sizeof(QuadQueryWorker));
+    pool->worker_count = 0;
+    if (!pool->lock || !pool->wake || !pool->done || !pool->workers)
+    {
+        ERROR_LOG("Unable to create a query pool of %d workers!\n", workers);
+        quad_free_query_pool(pool);
+        return false;
+    }
+
+    // The first worker is whoever runs the batch.
+    for (int i = 0; i < workers; i++)
+    {
+        QuadQueryWorker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        if (i > 0)
+        {
+            worker->thread = SDL_CreateThread(quad_query_thread, "quadquery", worker);
+            if (!worker->thread)
+            {
+                ERROR_LOG("Unable to start query thread %d: %s\n", i, SDL_GetError());
+                break;
+            }
+        }
+        pool->worker_count++;
+    }
+    return true;
+}
+
+/**
+ * Run every query of a batch against the tree under node across the pool,
+ * returning once they have all finished. Returns false if any query ran out
+ * of memory for its results.
+ */
+bool quad_run_queries(QuadQueryPool *pool, QuadTreeNode *node, QuadQuery *queries,
+                      size_t count)
+{
+    for (int i = 0; i < pool->worker_count; i++)
+    {
+        pool->workers[i].count = 0;
+        pool->workers[i].failed = false;
+    }
+
+    // Hand the batch to the threads.
+    SDL_LockMutex(pool->lock);
+    pool->node = node;
+    pool->queries = queries;
+    pool->query_count = count;
+    SDL_AtomicSet(&pool->next, 0);
+    pool->busy = pool->worker_count - 1;
+    pool->generation++;
+    SDL_CondBroadcast(pool->wake);
+    SDL_UnlockMutex(pool->lock);
+
+    // Do our share and wait on the rest.
+    quad_drain_queries(&pool->workers[0]);
+    SDL_LockMutex(pool->lock);
+    while (pool->busy > 0)
+        SDL_CondWait(pool->done, pool->lock);
+    SDL_UnlockMutex(pool->lock);
+
+    // The buffers have stopped moving, point each query at its results.
+    bool succeeded = true;
+    for (int i = 0; i < pool->worker_count; i++)
+        succeeded = succeeded && !pool->workers[i].failed;
+    for (size_t i = 0; i < count; i++)
+    {
+        QuadQueryWorker *worker = &pool->workers[queries[i].worker];
+        queries[i].found = queries[i].count > 0 ? worker->results + queries[i].offset : NULL;
+    }
+    return succeeded;
+}
+
+/**
+ * Stop the threads of the pool and free their results.
+ */
+void quad_free_query_pool(QuadQueryPool *pool)
+{
+    if (pool->lock)
+    {
+        SDL_LockMutex(pool->lock);
+        pool->closing = true;
+        if (pool->wake)
+            SDL_CondBroadcast(pool->wake);
+        SDL_UnlockMutex(pool->lock);
+    }
+
+    if (pool->workers)
+    {
+        for (int i = 0; i < pool->worker_count; i++)
+        {
+            SDL_WaitThread(pool->workers[i].thread, NULL);
+            free(pool->workers[i].results);
+        }
+        free(pool->workers);
+    }
+
+    if (pool->done)
+        SDL_DestroyCond(pool->done);
+    if (pool->wake)
+        SDL_DestroyCond(pool->wake);
+    if (pool->lock)
+        SDL_DestroyMutex(pool->lock);
+
+    pool->workers = NULL;
+    pool->worker_count = 0;
+    pool->lock = NULL;
+    pool->wake = NULL;
+    pool->done = NULL;
+}
@@ -0,0 +1,132 @@
+#include <SDL2/SDL.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "../../include/managers/quadlanes.h"
+#include "../../include/managers/quadtree.h"
+
+// ---------------- Main functions ----------------
+
+/**
+ * Pack the loose bounds of the children of node into its lanes.
+ */
+void quad_lanes_set(QuadTreeNode *node)
+{
+    for (Quadrent q = 0; q < QUADRENTS; q++)
+    {
+        SDL_Rect loose = node->children[q]->loose;
+        node->lanes.x0[q] = loose.x;
+        node->lanes.y0[q] = loose.y;
+        node->lanes.x1[q] = loose.x + loose.w;
+        node->lanes.y1[q] = loose.y + loose.h;
+    }
+}
+
+#if defined(__SSE2__)
+
+/**
+ * Get the mask of children overlapping rect, as is_overlap would. If inside
+ * is given it receives the mask of children rect holds entirely, as
+ * is_inside would.
+ */
+unsigned quad_lanes_overlap(const QuadLanes *lanes, SDL_Rect rect, unsigned *inside)
+{
+    // Children are never empty, so only an empty rect can miss on size alone.
+    if (rect.w <= 0 || rect.h <= 0)
+    {
+        if (inside)
+            *inside = 0;
+        return 0;
+    }
+
+    __m128i x0 = _mm_loadu_si128((const __m128i *)lanes->x0);
+    __m128i y0 = _mm_loadu_si128((const __m128i *)lanes->y0);
+    __m128i x1 = _mm_loadu_si128((const __m128i *)lanes->x1);
+    __m128i y1 = _mm_loadu_si128((const __m128i *)lanes->y1);
+    __m128i rx0 = _mm_set1_epi32(rect.x);
+    __m128i ry0 = _mm_set1_epi32(rect.y);
+    __m128i rx1 = _mm_set1_epi32(rect.x + rect.w);
+    __m128i ry1 = _mm_set1_epi32(rect.y + rect.h);
+
+    __m128i overlap = _mm_and_si128(
+        _mm_and_si128(_mm_cmplt_epi32(rx0, x1), _mm_cmplt_epi32(x0, rx1)),
+        _mm_and_si128(_mm_cmplt_epi32(ry0, y1), _mm_cmplt_epi32(y0, ry1)));
+
+    if (inside)
+    {
+        // Held entirely, no lane edge falls outside of rect.
+        __m128i outside = _mm_or_si128(
+            _mm_or_si128(_mm_cmplt_epi32(x0, rx0), _mm_cmplt_epi32(y0, ry0)),
+            _mm_or_si128(_mm_cmpgt_epi32(x1, rx1), _mm_cmpgt_epi32(y1, ry1)));
+        *inside = ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & QUAD_ALL_LANES;
+    }
+    return _mm_movemask_ps(_mm_castsi128_ps(overlap));
+}
+
+/**
+ * Get the mask of children whose bounds hold point, edges included as in
+ * is_collision.
+ */
+unsigned quad_lanes_hold(const QuadLanes *lanes, SDL_Point point)
+{
+    __m128i px = _mm_set1_epi32(point.x);
+    __m128i py = _mm_set1_epi32(point.y);
+
+    __m128i outside = _mm_or_si128(
+        _mm_or_si128(_mm_cmplt_epi32(px, _mm_loadu_si128((const __m128i *)lanes->x0)),
+                     _mm_cmplt_epi32(py, _mm_loadu_si128((const __m128i *)lanes->y0))),
+        _mm_or_si128(_mm_cmpgt_epi32(px, _mm_loadu_si128((const __m128i *)lanes->x1)),
+                     _mm_cmpgt_epi32(py, _mm_loadu_si128((const __m128i *)lanes->y1))));
+    return ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & QUAD_ALL_LANES;
+}
+
+#else
+
+/**
+ * Get the mask of children overlapping rect, as is_overlap would. If inside
+ * is given it receives the mask of children rect holds entirely, as
+ * is_inside would.
+ */
+unsigned quad_lanes_overlap(const QuadLanes *lanes, SDL_Rect rect, unsigned *inside)
+{
+    unsigned overlap = 0, held = 0;
+    // Children are never empty, so only an empty rect can miss on size alone.
+    if (rect.w > 0 && rect.h > 0)
+    {
+        int32_t x1 = rect.x + rect.w;
+        int32_t y1 = rect.y + rect.h;
+        for (Quadrent q = 0; q < QUADRENTS; q++)
+        {
+            if (rect.x < lanes->x1[q] && lanes->x0[q] < x1 &&
+                rect.y < lanes->y1[q] && lanes->y0[q] < y1)
+                overlap |= 1u << q;
+            if (lanes->x0[q] >= rect.x && lanes->y0[q] >= rect.y &&
+                lanes->x1[q] <= x1 && lanes->y1[q] <= y1)
+                held |= 1u << q;
+        }
+    }
+
+    if (inside)
+        *inside = held;
+    return overlap;
+}
+
+/**
+ * Get the mask of children whose bounds hold point, edges included as in
+ * is_collision.
+ */
+unsigned quad_lanes_hold(const QuadLanes *lanes, SDL_Point point)
+{
+    unsigned hold = 0;
+    for (Quadrent q = 0; q < QUADRENTS; q++)
+    {
+        if (point.x >= lanes->x0[q] && point.x <= lanes->x1[q] &&
+            point.y >= lanes->y0[q] && point.y <= lanes->y1[q])
+            hold |= 1u << q;
+    }
+    return hold;
+}
+
+#endif
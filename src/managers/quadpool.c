@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "../../include/debug.h"
+#include "../../include/managers/quadpool.h"
+#include "../../include/managers/quadtree.h"
+
+/***************************************************************************
+ * A slab allocator handing out the four children of a split as one block. *
+ ***************************************************************************/
+
+// Blocks in the first slab, each slab after doubles up to the maximum.
+#define POOL_FIRST_SLAB 16
+#define POOL_MAX_SLAB 4096
+
+/**
+ * Carve a new slab of blocks for the pool to bump allocate from.
+ */
+static bool quad_pool_grow(QuadNodePool *pool, uint32_t blocks)
+{
+    if (pool->slab_count >= pool->slab_maximum)
+    {
+        pool->slab_maximum = pool->slab_maximum ? pool->slab_maximum * 2 : 8;
+        void **slabs = (void **)realloc(pool->slabs, sizeof(void *) * pool->slab_maximum);
+        if (!slabs)
+            return false;
+        pool->slabs = slabs;
+    }
+
+    char *slab = (char *)malloc(pool->block_size * blocks);
+    if (!slab)
+    {
+        ERROR_LOG("Unable to allocate a slab of %u quad tree nodes!\n", blocks * QUADRENTS);
+        return false;
+    }
+    pool->slabs[pool->slab_count++] = slab;
+    pool->bytes += pool->block_size * blocks;
+    pool->cursor = slab;
+    pool->end = slab + pool->block_size * blocks;
+    return true;
+}
+
+/**
+ * Initialize the pool for nodes holding up to capacity entities.
+ */
+bool quad_init_pool(QuadNodePool *pool, uint16_t capacity)
+{
+    pool->capacity = capacity;
+    // Four nodes followed by their four buckets.
+    pool->block_size = QUADRENTS * (sizeof(QuadTreeNode) + sizeof(Entity *) * capacity);
+    pool->blocks_per_slab = POOL_FIRST_SLAB;
+    pool->slabs = NULL;
+    pool->slab_count = 0;
+    pool->slab_maximum = 0;
+    pool->bytes = 0;
+    pool->cursor = NULL;
+    pool->end = NULL;
+    pool->released = NULL;
+    return true;
+}
+
+/**
+ * Allocate four contiguous nodes with their buckets wired up.
+ */
+QuadTreeNode *quad_pool_alloc(QuadNodePool *pool)
+{
+    QuadTreeNode *block = NULL;
+
+    // Reuse a released block first.
+    if (pool->released)
+    {
+        block = (QuadTreeNode *)pool->released;
+        pool->released = pool->released->next;
+    }
+    else
+    {
+        if (pool->cursor == pool->end)
+        {
+            if (!quad_pool_grow(pool, pool->blocks_per_slab))
+                return NULL;
+            // The next slab will be larger.
+            if (pool->blocks_per_slab < POOL_MAX_SLAB)
+                pool->blocks_per_slab *= 2;
+        }
+        block = (QuadTreeNode *)pool->cursor;
+        pool->cursor += pool->block_size;
+    }
+
+    // Point each node at its bucket after the nodes.
+    Entity **buckets = (Entity **)(block + QUADRENTS);
+    for (Quadrent q = 0; q < QUADRENTS; q++)
+        block[q].entities = block[q].bucket = buckets + q * pool->capacity;
+
+    return block;
+}
+
+/**
+ * Make sure the next blocks allocations are carved back to back from one
+ * slab, the pool must have no released blocks.
+ */
+bool quad_pool_reserve(QuadNodePool *pool, uint32_t blocks)
+{
+    if ((size_t)(pool->end - pool->cursor) >= pool->block_size * blocks)
+        return true;
+    return quad_pool_grow(pool, blocks);
+}
+
+/**
+ * Hand a block returned by quad_pool_alloc back to the pool.
+ */
+void quad_pool_release(QuadNodePool *pool, QuadTreeNode *block)
+{
+    QuadPoolBlock *released = (QuadPoolBlock *)block;
+    released->next = pool->released;
+    pool->released = released;
+}
+
+/**
+ * Take over every slab and released block of other, leaving it empty. Both
+ * pools must hold nodes of the same capacity.
+ */
+bool quad_pool_adopt(QuadNodePool *pool, QuadNodePool *other)
+{
+    uint32_t slab_count = pool->slab_count + other->slab_count;
+    if (slab_count > pool->slab_maximum)
+    {
+        void **slabs = (void **)realloc(pool->slabs, sizeof(void *) * slab_count);
+        if (!slabs)
+            return false;
+        pool->slabs = slabs;
+        pool->slab_maximum = slab_count;
+    }
+    if (other->slab_count)
+        memcpy(pool->slabs + pool->slab_count, other->slabs, sizeof(void *) * other->slab_count);
+    pool->slab_count = slab_count;
+    pool->bytes += other->bytes;
+
+    // Their released blocks go ahead of ours.
+    if (other->released)
+    {
+        QuadPoolBlock *last = other->released;
+        while (last->next)
+            last = last->next;
+        last->next = pool->released;
+        pool->released = other->released;
+    }
+
+    // Carry on from whichever slab has more left in it.
+    if (other->end - other->cursor > pool->end - pool->cursor)
+    {
+        pool->cursor = other->cursor;
+        pool->end = other->end;
+    }
+    if (other->blocks_per_slab > pool->blocks_per_slab)
+        pool->blocks_per_slab = other->blocks_per_slab;
+
+    free(other->slabs);
+    quad_init_pool(other, other->capacity);
+    return true;
+}
+
+/**
+ * Free every slab in the pool, and with them every node ever allocated.
+ */
+void quad_free_pool(QuadNodePool *pool)
+{
+    for (uint32_t i = 0; i < pool->slab_count; i++)
+        free(pool->slabs[i]);
+
+    free(pool->slabs);
+    quad_init_pool(pool, pool->capacity);
+}
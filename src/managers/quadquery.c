@@ -0,0 +1,664 @@
+#include <SDL2/SDL.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../../include/debug.h"
+#include "../../include/managers/quadquery.h"
+#include "../../include/managers/quadtree.h"
+#include "../../include/managers/quadlanes.h"
+#include "../../include/managers/quadsearch.h"
+#include "../../include/managers/quadwalk.h"
+#include "../../include/entities/entity.h"
+#include "../../include/util/camera.h"
+
+/**
+ * A caller supplied buffer of pairs being filled by a query.
+ */
+typedef struct QuadPairBuffer
+{
+    QuadPair *pairs;
+    size_t count;
+    size_t maximum;
+} QuadPairBuffer;
+
+/**
+ * A search for overlapping pairs.
+ */
+typedef struct QuadPairing
+{
+    // How far entities can reach past the loose bounds of their node.
+    int margin;
+    QuadPairVisitor visit;
+    void *data;
+    size_t count;
+} QuadPairing;
+
+/**
+ * An entity being paired with everything under a node its reach overlaps.
+ */
+typedef struct QuadPairReach
+{
+    QuadPairing *pairing;
+    Entity *entity;
+    // Its position grown by the margin.
+    SDL_Rect reach;
+    QuadTreeNode *start;
+    // Children of the node at each depth on the way down the reach overlaps.
+    unsigned overlap[QUAD_WALK_DEPTH + 1];
+} QuadPairReach;
+
+/**
+ * Two subtrees sharing no nodes, waiting to be paired with each other.
+ */
+typedef struct QuadSubtrees
+{
+    QuadTreeNode *a;
+    QuadTreeNode *b;
+} QuadSubtrees;
+
+/**
+ * A search for entities overlapping a rect.
+ */
+typedef struct QuadRectSearch
+{
+    SDL_Rect rect;
+    // Children are grown by this much, see quad_margin.
+    int margin;
+    QuadVisitor visit;
+    void *data;
+    size_t count;
+    QuadTreeNode *start;
+    // Children of the node at each depth on the way down that overlap rect,
+    // and that rect holds entirely.
+    unsigned overlap[QUAD_WALK_DEPTH + 1];
+    unsigned inside[QUAD_WALK_DEPTH + 1];
+} QuadRectSearch;
+
+/**
+ * A search for entities whose centre lies within a radius of a point.
+ */
+typedef struct QuadCircle
+{
+    SDL_Point point;
+    // Squared.
+    int64_t radius;
+    QuadVisitor visit;
+    void *data;
+    size_t count;
+    QuadTreeNode *start;
+    // Whether the node at each depth on the way down lies inside the circle.
+    bool contained[QUAD_WALK_DEPTH + 1];
+} QuadCircle;
+
+/**
+ * A node the ray crosses and where it enters the node.
+ */
+typedef struct QuadCrossing
+{
+    QuadTreeNode *node;
+    float enter;
+} QuadCrossing;
+
+/**
+ * A segment being cast through the tree and what it has hit so far.
+ */
+typedef struct QuadRay
+{
+    float x;
+    float y;
+    float dx;
+    float dy;
+    // Hits nearest first, or just the nearest hit if maximum is 1.
+    QuadHit *hits;
+    size_t count;
+    size_t maximum;
+    // Children are grown by this much, see quad_margin.
+    int margin;
+} QuadRay;
+
+// Pairs of subtrees pairing across can have waiting at once, each level leaves fifteen behind.
+#define QUAD_PAIR_STACK (QUAD_WALK_DEPTH * (QUADRENTS * QUADRENTS - 1) + QUADRENTS * QUADRENTS)
+
+// ---------------- Helper functions ----------------
+
+/**
+ * Visit the entities of a node whose centre is within the squared radius,
+ * skipping the bounds checks below a node inside the circle.
+ */
+static QuadWalkAction quad_visit_circle(QuadTreeNode *node, void *data)
+{
+    QuadCircle *circle = (QuadCircle *)data;
+    bool contained = node != circle->start && circle->contained[node->parent->depth];
+    if (!contained)
+    {
+        if (quad_distance_to_rect(node->bounds, circle->point) > circle->radius)
+            return QUAD_WALK_SKIP;
+        contained = quad_reach_of_rect(node->bounds, circle->point) <= circle->radius;
+    }
+    circle->contained[node->depth] = contained;
+
+    for (uint16_t i = 0; i < node->count; i++)
+    {
+        if (!contained &&
+            quad_distance_to_centre(node->entities[i]->position, circle->point) > circle->radius)
+            continue;
+        circle->count++;
+        if (!circle->visit(node->entities[i], circle->data))
+            return QUAD_WALK_STOP;
+    }
+    return QUAD_WALK_CONTINUE;
+}
+
+/**
+ * Where does the ray enter rect? Returns false if it misses.
+ */
+static bool quad_ray_enters(QuadRay *ray, SDL_Rect rect, float *enter)
+{
+    float near = 0.0f, far = 1.0f;
+    float origin[2] = {ray->x, ray->y};
+    float direction[2] = {ray->dx, ray->dy};
+    float low[2] = {rect.x, rect.y};
+    float high[2] = {rect.x + rect.w, rect.y + rect.h};
+
+    // Clip the segment against each slab.
+    for (int axis = 0; axis < 2; axis++)
+    {
+        if (direction[axis] == 0.0f)
+        {
+            if (origin[axis] < low[axis] || origin[axis] > high[axis])
+                return false;
+            continue;
+        }
+        float a = (low[axis] - origin[axis]) / direction[axis];
+        float b = (high[axis] - origin[axis]) / direction[axis];
+        near = SDL_max(near, SDL_min(a, b));
+        far = SDL_min(far, SDL_max(a, b));
+        if (near > far)
+            return false;
+    }
+    *enter = near;
+    return true;
+}
+
+/**
+ * How far along the ray can a hit still make it into the results?
+ */
+static inline float quad_ray_limit(QuadRay *ray)
+{
+    return ray->count < ray->maximum ? 1.0f : ray->hits[ray->count - 1].distance;
+}
+
+/**
+ * Record a hit, keeping the hits sorted and dropping the furthest when full.
+ */
+static void quad_ray_hit(QuadRay *ray, Entity *entity, float distance)
+{
+    if (ray->count == ray->maximum)
+    {
+        if (distance >= ray->hits[ray->count - 1].distance)
+            return;
+        ray->count--;
+    }
+
+    size_t i = ray->count++;
+    for (; i > 0 && ray->hits[i - 1].distance > distance; i--)
+        ray->hits[i] = ray->hits[i - 1];
+    ray->hits[i] = (QuadHit){.entity = entity, .distance = distance};
+}
+
+/**
+ * Cast the ray through node, visiting the children it crosses front to back
+ * and skipping any that start beyond the furthest hit we would keep. Children
+ * are grown by the margin, so no entity in one is entered before its bounds.
+ */
+static void quad_cast_node(QuadTreeNode *node, QuadRay *ray)
+{
+    QuadCrossing stack[QUAD_WALK_STACK];
+    int top = 0;
+    stack[0] = (QuadCrossing){.node = node, .enter = 0.0f};
+    while (top >= 0)
+    {
+        QuadCrossing crossing = stack[top--];
+        if (crossing.enter > quad_ray_limit(ray))
+            continue;
+
+        node = crossing.node;
+        for (uint16_t i = 0; i < node->count; i++)
+        {
+            float distance;
+            if (quad_ray_enters(ray, node->entities[i]->position, &distance))
+                quad_ray_hit(ray, node->entities[i], distance);
+        }
+
+        if (!node->children[TOPLEFT])
+            continue;
+        if (top + QUADRENTS >= QUAD_WALK_STACK)
+        {
+            ERROR_LOG("Quad tree deeper than %d levels, skipping a branch!\n", QUAD_WALK_DEPTH);
+            continue;
+        }
+
+        // Order the children the ray passes through furthest first, so the
+        // nearest comes off the stack next.
+        QuadCrossing crossed[QUADRENTS];
+        int count = 0;
+        for (Quadrent q = 0; q < QUADRENTS; q++)
+        {
+            float enter;
+            QuadTreeNode *child = node->children[q];
+            if (child->total == 0 ||
+                !quad_ray_enters(ray, quad_inflate(child->loose, ray->margin), &enter))
+                continue;
+
+            int i = count++;
+            for (; i > 0 && crossed[i - 1].enter < enter; i--)
+                crossed[i] = crossed[i - 1];
+            crossed[i] = (QuadCrossing){.node = child, .enter = enter};
+        }
+        for (int i = 0; i < count; i++)
+            stack[++top] = crossed[i];
+    }
+}
+
+/**
+ * Cast a segment from start to end, filling hits nearest first.
+ */
+static size_t quad_cast(QuadTreeNode *node, SDL_Point start, SDL_Point end, QuadHit *hits,
+                        size_t maximum)
+{
+    QuadRay ray = {.x = start.x,
+                   .y = start.y,
+                   .dx = end.x - start.x,
+                   .dy = end.y - start.y,
+                   .hits = hits,
+                   .count = 0,
+                   .maximum = maximum,
+                   .margin = node ? quad_margin(node->tree) : 0};
+
+    // The bucket of node is always checked, the root may hold entities larger than it.
+    if (node && maximum > 0)
+        quad_cast_node(node, &ray);
+    return ray.count;
+}
+
+/**
+ * Visit the entities of a node that overlap rect and classify its children
+ * together through its lanes, grown by the margin for entities hanging out of
+ * them. The bounds checks are skipped below a node contained by rect.
+ */
+static QuadWalkAction quad_visit_node(QuadTreeNode *node, void *data)
+{
+    QuadRectSearch *search = (QuadRectSearch *)data;
+    bool contained = false;
+    if (node != search->start)
+    {
+        // Children are one block, so their offset is their quadrent.
+        unsigned lane = 1u << (node - node->parent->children[TOPLEFT]);
+        if (node->total == 0 || !(search->overlap[node->parent->depth] & lane))
+            return QUAD_WALK_SKIP;
+        contained = search->inside[node->parent->depth] & lane;
+    }
+
+    for (uint16_t i = 0; i < node->count; i++)
+    {
+        if (!is_overlap(search->rect, node->entities[i]->position))
+            continue;
+        search->count++;
+        if (!search->visit(node->entities[i], search->data))
+            return QUAD_WALK_STOP;
+    }
+
+    if (!node->children[TOPLEFT])
+        return QUAD_WALK_CONTINUE;
+
+    // Growing a child by margin is the same as growing rect by it, and shrinking
+    // rect by it for the children rect holds entirely.
+    unsigned overlap = QUAD_ALL_LANES, inside = QUAD_ALL_LANES;
+    if (!contained && search->margin == 0)
+        overlap = quad_lanes_overlap(&node->lanes, search->rect, &inside);
+    else if (!contained)
+    {
+        overlap = quad_lanes_overlap(&node->lanes, quad_inflate(search->rect, search->margin),
+                                     NULL);
+        quad_lanes_overlap(&node->lanes, quad_inflate(search->rect, -search->margin), &inside);
+    }
+    search->overlap[node->depth] = overlap;
+    search->inside[node->depth] = inside;
+    return QUAD_WALK_CONTINUE;
+}
+
+/**
+ * Visit two entities if they overlap. Returns false if the visitor stopped.
+ */
+static inline bool quad_pair(QuadPairing *pairing, Entity *first, Entity *second)
+{
+    if (!is_overlap(first->position, second->position))
+        return true;
+
+    pairing->count++;
+    return pairing->visit(first, second, pairing->data);
+}
+
+/**
+ * Pair the entity with the bucket of a node, leaving out subtrees its reach
+ * does not overlap as found by the parent's lanes.
+ */
+static QuadWalkAction quad_pair_entity(QuadTreeNode *node, void *data)
+{
+    QuadPairReach *reach = (QuadPairReach *)data;
+    // Children are one block, so their offset is their quadrent.
+    if (node != reach->start &&
+        (node->total == 0 || !(reach->overlap[node->parent->depth] &
+                               (1u << (node - node->parent->children[TOPLEFT])))))
+        return QUAD_WALK_SKIP;
+
+    for (uint16_t i = 0; i < node->count; i++)
+    {
+        if (!quad_pair(reach->pairing, reach->entity, node->entities[i]))
+            return QUAD_WALK_STOP;
+    }
+
+    if (node->children[TOPLEFT])
+        reach->overlap[node->depth] = quad_lanes_overlap(&node->lanes, reach->reach, NULL);
+    return QUAD_WALK_CONTINUE;
+}
+
+/**
+ * Pair every entity of a bucket with everything under node they overlap.
+ * Returns false if the visitor stopped.
+ */
+static bool quad_pair_bucket(QuadPairing *pairing, QuadTreeNode *bucket, QuadTreeNode *node)
+{
+    for (uint16_t i = 0; i < bucket->count; i++)
+    {
+        Entity *entity = bucket->entities[i];
+        QuadPairReach reach = {.pairing = pairing,
+                               .entity = entity,
+                               .reach = quad_inflate(entity->position, pairing->margin),
+                               .start = node};
+        if (!quad_walk(node, quad_pair_entity, NULL, &reach))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Pair everything under a with everything under b, two subtrees that do not
+ * share any nodes. Returns false if the visitor stopped.
+ */
+static bool quad_pair_across(QuadPairing *pairing, QuadTreeNode *a, QuadTreeNode *b)
+{
+    QuadSubtrees stack[QUAD_PAIR_STACK];
+    int top = 0;
+    stack[0] = (QuadSubtrees){.a = a, .b = b};
+    while (top >= 0)
+    {
+        a = stack[top].a;
+        b = stack[top].b;
+        top--;
+
+        // Nothing under one can reach anything under the other.
+        if (a->total == 0 || b->total == 0 ||
+            !is_overlap(quad_inflate(a->loose, 2 * pairing->margin), b->loose))
+            continue;
+
+        // The bucket of a against all of b.
+        if (!quad_pair_bucket(pairing, a, b))
+            return false;
+
+        if (!a->children[TOPLEFT])
+            continue;
+
+        // The bucket of b against what is below a.
+        for (Quadrent q = 0; q < QUADRENTS; q++)
+        {
+            if (!quad_pair_bucket(pairing, b, a->children[q]))
+                return false;
+        }
+
+        // What is below a against what is below b.
+        if (!b->children[TOPLEFT])
+            continue;
+        if (top + QUADRENTS * QUADRENTS >= QUAD_PAIR_STACK)
+        {
+            ERROR_LOG("Quad tree deeper than %d levels, skipping a branch!\n", QUAD_WALK_DEPTH);
+            continue;
+        }
+
+        // Pushed backwards so they come off in quadrent order.
+        for (int qa = QUADRENTS - 1; qa >= 0; qa--)
+        {
+            for (int qb = QUADRENTS - 1; qb >= 0; qb--)
+                stack[++top] = (QuadSubtrees){.a = a->children[qa], .b = b->children[qb]};
+        }
+    }
+    return true;
+}
+
+/**
+ * Pair everything in the bucket of a node with everything else under it, the
+ * walk pairs its children with themselves as it reaches them.
+ */
+static QuadWalkAction quad_pair_within(QuadTreeNode *node, void *data)
+{
+    QuadPairing *pairing = (QuadPairing *)data;
+    if (node->total < 2)
+        return QUAD_WALK_SKIP;
+
+    // The bucket against itself.
+    for (uint16_t i = 0; i < node->count; i++)
+    {
+        for (uint16_t j = i + 1; j < node->count; j++)
+        {
+            if (!quad_pair(pairing, node->entities[i], node->entities[j]))
+                return QUAD_WALK_STOP;
+        }
+    }
+
+    if (!node->children[TOPLEFT])
+        return QUAD_WALK_CONTINUE;
+
+    // The bucket against the children, then the children against each other.
+    for (Quadrent q = 0; q < QUADRENTS; q++)
+    {
+        if (!quad_pair_bucket(pairing, node, node->children[q]))
+            return QUAD_WALK_STOP;
+    }
+    for (Quadrent qa = 0; qa < QUADRENTS; qa++)
+    {
+        for (Quadrent qb = qa + 1; qb < QUADRENTS; qb++)
+        {
+            if (!quad_pair_across(pairing, node->children[qa], node->children[qb]))
+                return QUAD_WALK_STOP;
+        }
+    }
+    return QUAD_WALK_CONTINUE;
+}
+
+/**
+ * Append a pair to a buffer, stopping the query once it is full.
+ */
+static bool quad_buffer_pair(Entity *first, Entity *second, void *data)
+{
+    QuadPairBuffer *buffer = (QuadPairBuffer *)data;
+    buffer->pairs[buffer->count].first = first;
+    buffer->pairs[buffer->count].second = second;
+    buffer->count++;
+    return buffer->count < buffer->maximum;
+}
+
+// ---------------- Main functions ----------------
+
+/**
+ * Visit every entity overlapping rect, returns the number visited.
+ */
+size_t quad_visit_rect(QuadTreeNode *node, SDL_Rect rect, QuadVisitor visit, void *data)
+{
+    if (!node)
+        return 0;
+
+    // The bucket of node is always checked, the root may hold entities larger than it.
+    QuadRectSearch search = {.rect = rect,
+                             .margin = quad_margin(node->tree),
+                             .visit = visit,
+                             .data = data,
+                             .count = 0,
+                             .start = node};
+    quad_walk(node, quad_visit_node, NULL, &search);
+    return search.count;
+}
+
+/**
+ * Collect up to maximum entities overlapping rect, returns the number written
+ * to found.
+ */
+size_t quad_query_rect(QuadTreeNode *node, SDL_Rect rect, Entity **found, size_t maximum)
+{
+    if (maximum == 0)
+        return 0;
+
+    QuadBuffer buffer = {.found = found, .count = 0, .maximum = maximum};
+    quad_visit_rect(node, rect, &quad_buffer_entity, &buffer);
+    return buffer.count;
+}
+
+/**
+ * Visit every entity whose centre lies within radius of point, returns the
+ * number visited.
+ */
+size_t quad_visit_radius(QuadTreeNode *node, SDL_Point point, int radius, QuadVisitor visit,
+                         void *data)
+{
+    if (!node || radius < 0)
+        return 0;
+
+    QuadCircle circle = {.point = point,
+                         .radius = (int64_t)radius * radius,
+                         .visit = visit,
+                         .data = data,
+                         .count = 0,
+                         .start = node};
+    quad_walk(node, quad_visit_circle, NULL, &circle);
+    return circle.count;
+}
+
+/**
+ * Collect up to maximum entities whose centre lies within radius of point,
+ * returns the number written to found.
+ */
+size_t quad_query_radius(QuadTreeNode *node, SDL_Point point, int radius, Entity **found,
+                         size_t maximum)
+{
+    if (maximum == 0)
+        return 0;
+
+    QuadBuffer buffer = {.found = found, .count = 0, .maximum = maximum};
+    quad_visit_radius(node, point, radius, &quad_buffer_entity, &buffer);
+    return buffer.count;
+}
+
+/**
+ * Collect the k entities whose centres are closest to point, nearest first.
+ * Returns the number written to found, fewer than k if the tree runs out.
+ */
+size_t quad_query_knn(QuadTreeNode *node, SDL_Point point, size_t k, Entity **found)
+{
+    if (!node || k == 0 || node->total == 0)
+        return 0;
+    if (k > node->total)
+        k = node->total;
+
+    QuadNearest nearest;
+    if (!quad_nearest_init(&nearest, k))
+        return 0;
+
+    QuadQueue queue;
+    quad_queue_init(&queue);
+    quad_queue_push(&queue, (QuadQueued){.distance = quad_distance_to_rect(node->bounds, point),
+                                         .node.pointer = node});
+
+    while (queue.count > 0)
+    {
+        QuadQueued next = quad_queue_pop(&queue);
+        // Nothing left can beat the furthest we have.
+        if (!quad_nearest_wants(&nearest, next.distance))
+            break;
+
+        QuadTreeNode *n = (QuadTreeNode *)next.node.pointer;
+        for (uint16_t i = 0; i < n->count; i++)
+            quad_nearest_offer(&nearest, n->entities[i],
+                               quad_distance_to_centre(n->entities[i]->position, point));
+
+        for (Quadrent q = 0; q < QUADRENTS; q++)
+        {
+            QuadTreeNode *child = n->children[q];
+            if (!child || child->total == 0)
+                continue;
+            int64_t distance = quad_distance_to_rect(child->bounds, point);
+            if (quad_nearest_wants(&nearest, distance) &&
+                !quad_queue_push(&queue, (QuadQueued){.distance = distance, .node.pointer = child}))
+                break;
+        }
+    }
+
+    quad_queue_free(&queue);
+    return quad_nearest_finish(&nearest, found);
+}
+
+/**
+ * Cast a segment from start to end and return the first entity it hits, or
+ * NULL if it hits nothing. Sets distance to where the hit was if provided.
+ */
+Entity *quad_raycast(QuadTreeNode *node, SDL_Point start, SDL_Point end, float *distance)
+{
+    QuadHit hit;
+    if (quad_cast(node, start, end, &hit, 1) == 0)
+        return NULL;
+
+    if (distance)
+        *distance = hit.distance;
+    return hit.entity;
+}
+
+/**
+ * Cast a segment from start to end and collect up to maximum of the nearest
+ * entities it hits, nearest first. Returns the number written to hits.
+ */
+size_t quad_raycast_all(QuadTreeNode *node, SDL_Point start, SDL_Point end, QuadHit *hits,
+                        size_t maximum)
+{
+    return quad_cast(node, start, end, hits, maximum);
+}
+
+/**
+ * Visit every pair of entities under node whose positions overlap, each pair
+ * once. Returns the number of pairs visited.
+ */
+size_t quad_visit_overlapping_pairs(QuadTreeNode *node, QuadPairVisitor visit, void *data)
+{
+    if (!node)
+        return 0;
+
+    QuadPairing pairing = {
+        .margin = quad_margin(node->tree), .visit = visit, .data = data, .count = 0};
+
+    quad_walk(node, quad_pair_within, NULL, &pairing);
+    return pairing.count;
+}
+
+/**
+ * Collect up to maximum pairs of entities under node whose positions overlap,
+ * each pair once. Returns the number written to pairs.
+ */
+size_t quad_collect_overlapping_pairs(QuadTreeNode *node, QuadPair *pairs, size_t maximum)
+{
+    if (maximum == 0)
+        return 0;
+
+    QuadPairBuffer buffer = {.pairs = pairs, .count = 0, .maximum = maximum};
+    quad_visit_overlapping_pairs(node, &quad_buffer_pair, &buffer);
+    return buffer.count;
+}
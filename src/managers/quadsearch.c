@@ -0,0 +1,257 @@
+#include <SDL2/SDL.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../../include/debug.h"
+#include "../../include/managers/quadsearch.h"
+#include "../../include/managers/quadsnapshot.h"
+#include "../../include/util/camera.h"
+
+// ---------------- Helper functions ----------------
+
+/**
+ * Restore the max heap of the nearest downwards from index i.
+ */
+static void quad_nearest_sift(QuadRanked *ranked, size_t count, size_t i)
+{
+    QuadRanked moving = ranked[i];
+    for (size_t child = 2 * i + 1; child < count; child = 2 * i + 1)
+    {
+        if (child + 1 < count && ranked[child + 1].distance > ranked[child].distance)
+            child++;
+        if (ranked[child].distance <= moving.distance)
+            break;
+        ranked[i] = ranked[child];
+        i = child;
+    }
+    ranked[i] = moving;
+}
+
+/**
+ * Push the children of the node at index at for a later visit. Nodes are laid
+ * out depth first, so children a damaged mapping points back to, or outside
+ * of its nodes, are skipped rather than searched forever.
+ */
+static void quad_flat_push_children(QuadFlatSearch *search, const QuadSnapNode *node, uint32_t at)
+{
+    if (node->children <= at || node->children >= search->node_count ||
+        search->node_count - node->children < QUADRENTS)
+        return;
+    if (search->top + QUADRENTS >= QUAD_WALK_STACK)
+    {
+        ERROR_LOG("Snapshot is deeper than a search can follow, skipping a branch!\n");
+        return;
+    }
+
+    // Pushed backwards so they come off in quadrent order.
+    for (int q = QUADRENTS - 1; q >= 0; q--)
+        search->stack[++search->top] = node->children + q;
+}
+
+// ---------------- Main functions ----------------
+
+/**
+ * Initialize an empty queue using its inline storage.
+ */
+void quad_queue_init(QuadQueue *queue)
+{
+    queue->nodes = queue->local;
+    queue->count = 0;
+    queue->maximum = QUAD_QUEUE_SIZE;
+}
+
+/**
+ * Queue a node, growing onto the heap if the inline storage is full.
+ */
+bool quad_queue_push(QuadQueue *queue, QuadQueued queued)
+{
+    if (queue->count == queue->maximum)
+    {
+        size_t maximum = queue->maximum * 2;
+        QuadQueued *nodes = queue->nodes == queue->local
+                                ? (QuadQueued *)malloc(sizeof(QuadQueued) * maximum)
+                                : (QuadQueued *)realloc(queue->nodes, sizeof(QuadQueued) * maximum);
+        if (!nodes)
+        {
+            ERROR_LOG("Unable to grow the nearest neighbour queue!\n");
+            return false;
+        }
+        if (queue->nodes == queue->local)
+            memcpy(nodes, queue->local, sizeof(QuadQueued) * queue->count);
+        queue->nodes = nodes;
+        queue->maximum = maximum;
+    }
+
+    // Sift up.
+    size_t i = queue->count++;
+    while (i > 0 && queue->nodes[(i - 1) / 2].distance > queued.distance)
+    {
+        queue->nodes[i] = queue->nodes[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    queue->nodes[i] = queued;
+    return true;
+}
+
+/**
+ * Take the closest node off the queue.
+ */
+QuadQueued quad_queue_pop(QuadQueue *queue)
+{
+    QuadQueued top = queue->nodes[0];
+    QuadQueued last = queue->nodes[--queue->count];
+
+    // Sift down.
+    size_t i = 0;
+    for (size_t child = 1; child < queue->count; child = 2 * i + 1)
+    {
+        if (child + 1 < queue->count &&
+            queue->nodes[child + 1].distance < queue->nodes[child].distance)
+            child++;
+        if (queue->nodes[child].distance >= last.distance)
+            break;
+        queue->nodes[i] = queue->nodes[child];
+        i = child;
+    }
+    queue->nodes[i] = last;
+    return top;
+}
+
+/**
+ * Free anything the queue grew onto.
+ */
+void quad_queue_free(QuadQueue *queue)
+{
+    if (queue->nodes != queue->local)
+        free(queue->nodes);
+    quad_queue_init(queue);
+}
+
+/**
+ * Make room for the k nearest entities, returns false if memory ran out.
+ */
+bool quad_nearest_init(QuadNearest *nearest, size_t k)
+{
+    nearest->count = 0;
+    nearest->k = k;
+    nearest->ranked = (QuadRanked *)malloc(sizeof(QuadRanked) * k);
+    if (!nearest->ranked)
+    {
+        ERROR_LOG("Unable to allocate a search for %zu neighbours!\n", k);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Offer an entity at distance to the k nearest.
+ */
+void quad_nearest_offer(QuadNearest *nearest, Entity *entity, int64_t distance)
+{
+    if (nearest->count < nearest->k)
+    {
+        // Sift up.
+        size_t i = nearest->count++;
+        while (i > 0 && nearest->ranked[(i - 1) / 2].distance < distance)
+        {
+            nearest->ranked[i] = nearest->ranked[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        nearest->ranked[i] = (QuadRanked){.distance = distance, .entity = entity};
+    }
+    else if (distance < nearest->ranked[0].distance)
+    {
+        // Replace the furthest.
+        nearest->ranked[0] = (QuadRanked){.distance = distance, .entity = entity};
+        quad_nearest_sift(nearest->ranked, nearest->count, 0);
+    }
+}
+
+/**
+ * Write the nearest entities to found nearest first and free the heap,
+ * returns the number written.
+ */
+size_t quad_nearest_finish(QuadNearest *nearest, Entity **found)
+{
+    // Empty the heap from the back so the nearest ends up first.
+    size_t count = nearest->count;
+    for (size_t size = count; size > 0; size--)
+    {
+        found[size - 1] = nearest->ranked[0].entity;
+        nearest->ranked[0] = nearest->ranked[size - 1];
+        quad_nearest_sift(nearest->ranked, size - 1, 0);
+    }
+
+    free(nearest->ranked);
+    nearest->ranked = NULL;
+    nearest->count = 0;
+    return count;
+}
+
+/**
+ * Append an entity to a QuadBuffer, stopping the query once it is full.
+ */
+bool quad_buffer_entity(Entity *entity, void *data)
+{
+    QuadBuffer *buffer = (QuadBuffer *)data;
+    buffer->found[buffer->count++] = entity;
+    return buffer->count < buffer->maximum;
+}
+
+/**
+ * Start a depth first search from node 0 of nodes, whose entities hang out of
+ * their loose bounds by up to margin.
+ */
+void quad_flat_begin(QuadFlatSearch *search, const QuadSnapNode *nodes, uint32_t node_count,
+                     int margin)
+{
+    search->nodes = nodes;
+    search->node_count = node_count;
+    search->margin = margin;
+    search->top = node_count > 0 ? 0 : -1;
+    search->stack[0] = 0;
+}
+
+/**
+ * Get the next node, in quadrent order, that could hold an entity
+ * overlapping rect. The root is always given. Returns NULL once the search
+ * is over.
+ */
+const QuadSnapNode *quad_flat_next_rect(QuadFlatSearch *search, SDL_Rect rect)
+{
+    while (search->top >= 0)
+    {
+        uint32_t at = search->stack[search->top--];
+        const QuadSnapNode *node = &search->nodes[at];
+        SDL_Rect reach = quad_inflate(node->loose, search->margin);
+        if (at != 0 && (node->total == 0 || !is_overlap(rect, reach)))
+            continue;
+
+        quad_flat_push_children(search, node, at);
+        return node;
+    }
+    return NULL;
+}
+
+/**
+ * Get the next node, in quadrent order, that could hold an entity under
+ * point. The root is always given. Returns NULL once the search is over.
+ */
+const QuadSnapNode *quad_flat_next_point(QuadFlatSearch *search, SDL_Point point)
+{
+    while (search->top >= 0)
+    {
+        uint32_t at = search->stack[search->top--];
+        const QuadSnapNode *node = &search->nodes[at];
+        SDL_Rect reach = quad_inflate(node->loose, search->margin);
+        if (at != 0 && (node->total == 0 || !is_collision(point.x, point.y, reach)))
+            continue;
+
+        quad_flat_push_children(search, node, at);
+        return node;
+    }
+    return NULL;
+}
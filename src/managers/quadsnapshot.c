@@ -0,0 +1,337 @@
+#include <SDL2/SDL.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../../include/debug.h"
+#include "../../include/managers/quadsnapshot.h"
+#include "../../include/managers/quadsearch.h"
+#include "../../include/managers/quadtree.h"
+#include "../../include/managers/quadwalk.h"
+#include "../../include/util/camera.h"
+
+/**
+ * The state of a walk copying a tree into a snapshot.
+ */
+typedef struct QuadSnapFill
+{
+    QuadSnapshot *snapshot;
+    QuadTreeNode *start;
+    // Index of the node copied at each depth on the way down.
+    uint32_t index[QUAD_WALK_DEPTH + 1];
+    bool failed;
+} QuadSnapFill;
+
+// ---------------- Helper functions ----------------
+
+/**
+ * Make space for size more nodes in a snapshot.
+ */
+static bool quad_snap_reserve(QuadSnapshot *snapshot, uint32_t size)
+{
+    if (snapshot->node_count + size <= snapshot->node_maximum)
+        return true;
+
+    uint32_t maximum = snapshot->node_maximum ? snapshot->node_maximum * 2 : 64;
+    while (maximum < snapshot->node_count + size)
+        maximum *= 2;
+
+    QuadSnapNode *nodes = (QuadSnapNode *)realloc(snapshot->nodes, sizeof(QuadSnapNode) * maximum);
+    if (!nodes)
+    {
+        ERROR_LOG("Unable to grow a snapshot to %u nodes!\n", maximum);
+        return false;
+    }
+    snapshot->nodes = nodes;
+    snapshot->node_maximum = maximum;
+    return true;
+}
+
+/**
+ * Copy a node and its bucket into the snapshot, making room for its children
+ * next to each other.
+ */
+static QuadWalkAction quad_snap_node(QuadTreeNode *node, void *data)
+{
+    QuadSnapFill *fill = (QuadSnapFill *)data;
+    QuadSnapshot *snapshot = fill->snapshot;
+
+    // Children are one block, so their offset is their quadrent.
+    uint32_t at = 0;
+    if (node != fill->start)
+        at = snapshot->nodes[fill->index[node->parent->depth]].children +
+             (uint32_t)(node - node->parent->children[TOPLEFT]);
+    fill->index[node->depth] = at;
+
+    uint32_t children = 0;
+    if (node->children[TOPLEFT])
+    {
+        if (!quad_snap_reserve(snapshot, QUADRENTS))
+        {
+            fill->failed = true;
+            return QUAD_WALK_STOP;
+        }
+        children = snapshot->node_count;
+        snapshot->node_count += QUADRENTS;
+    }
+
+    QuadSnapNode *copy = &snapshot->nodes[at];
+    copy->bounds = node->bounds;
+    copy->loose = node->loose;
+    copy->first = snapshot->entry_count;
+    copy->count = node->count;
+    copy->total = node->total;
+    copy->children = children;
+
+    for (uint16_t i = 0; i < node->count; i++)
+    {
+        QuadSnapEntry *entry = &snapshot->entries[snapshot->entry_count++];
+        entry->entity = node->entities[i];
+        entry->position = node->entities[i]->position;
+    }
+    return QUAD_WALK_CONTINUE;
+}
+
+/**
+ * Replace the contents of a snapshot with a copy of the tree.
+ */
+static bool quad_snap_fill(QuadSnapshot *snapshot, QuadTree *quad)
+{
+    // Every entry fits in one allocation.
+    if (quad->root->total > snapshot->entry_maximum)
+    {
+        QuadSnapEntry *entries = (QuadSnapEntry *)realloc(
+            snapshot->entries, sizeof(QuadSnapEntry) * quad->root->total);
+        if (!entries)
+        {
+            ERROR_LOG("Unable to grow a snapshot to %u entities!\n", quad->root->total);
+            return false;
+        }
+        snapshot->entries = entries;
+        snapshot->entry_maximum = quad->root->total;
+    }
+
+    snapshot->node_count = 0;
+    snapshot->entry_count = 0;
+    snapshot->margin = quad_margin(quad);
+    if (!quad_snap_reserve(snapshot, 1))
+        return false;
+    snapshot->node_count = 1;
+
+    QuadSnapFill fill = {.snapshot = snapshot, .start = quad->root, .failed = false};
+    quad_walk(quad->root, quad_snap_node, NULL, &fill);
+    return !fill.failed;
+}
+
+// ---------------- Main functions ----------------
+
+/**
+ * Initialize an empty set of snapshots.
+ */
+void quad_init_snapshots(QuadSnapshots *snapshots)
+{
+    memset(snapshots, 0, sizeof(QuadSnapshots));
+    for (int i = 0; i < QUAD_SNAPSHOT_BUFFERS; i++)
+        SDL_AtomicSet(&snapshots->buffers[i].readers, 0);
+    SDL_AtomicSetPtr(&snapshots->current, NULL);
+}
+
+/**
+ * Copy the tree into a snapshot no reader holds and make it current, called
+ * by the thread changing the tree. Returns false if every snapshot is still
+ * held or memory ran out, readers keep the previous one.
+ */
+bool quad_publish_snapshot(QuadSnapshots *snapshots, QuadTree *quad)
+{
+    QuadSnapshot *current = (QuadSnapshot *)SDL_AtomicGetPtr(&snapshots->current);
+
+    // A reader that picks up a stale snapshot finds it is no longer current
+    // and lets go without reading, so one with no readers is free to refill.
+    QuadSnapshot *snapshot = NULL;
+    for (int i = 0; i < QUAD_SNAPSHOT_BUFFERS && !snapshot; i++)
+    {
+        QuadSnapshot *buffer = &snapshots->buffers[i];
+        if (buffer != current && SDL_AtomicGet(&buffer->readers) == 0)
+            snapshot = buffer;
+    }
+    if (!snapshot)
+    {
+        DEBUG_LOG("Every snapshot is still being read, skipping publish.\n");
+        return false;
+    }
+
+    if (!quad_snap_fill(snapshot, quad))
+        return false;
+
+    snapshot->frame = ++snapshots->frame;
+    SDL_AtomicSetPtr(&snapshots->current, snapshot);
+    return true;
+}
+
+/**
+ * Pick up the current snapshot, it stays unchanged until released. Returns
+ * NULL if nothing has been published.
+ *
+ * Only the tree is copied, the entities it hands out are still owned by the
+ * scene. clean_entities can free one while a reader holds the snapshot, so a
+ * reader must not dereference them unless it knows the owning thread is not
+ * cleaning up, and should rely on the positions the snapshot kept instead.
+ */
+const QuadSnapshot *quad_acquire_snapshot(QuadSnapshots *snapshots)
+{
+    for (;;)
+    {
+        QuadSnapshot *snapshot = (QuadSnapshot *)SDL_AtomicGetPtr(&snapshots->current);
+        if (!snapshot)
+            return NULL;
+
+        // Only safe to read if it was still current once we held it.
+        SDL_AtomicIncRef(&snapshot->readers);
+        if (SDL_AtomicGetPtr(&snapshots->current) == snapshot)
+            return snapshot;
+        SDL_AtomicAdd(&snapshot->readers, -1);
+    }
+}
+
+/**
+ * Hand back a snapshot from quad_acquire_snapshot.
+ */
+void quad_release_snapshot(const QuadSnapshot *snapshot)
+{
+    if (snapshot)
+        SDL_AtomicAdd(&((QuadSnapshot *)snapshot)->readers, -1);
+}
+
+/**
+ * Free every snapshot, no reader may hold one.
+ */
+void quad_free_snapshots(QuadSnapshots *snapshots)
+{
+    for (int i = 0; i < QUAD_SNAPSHOT_BUFFERS; i++)
+    {
+        free(snapshots->buffers[i].nodes);
+        free(snapshots->buffers[i].entries);
+    }
+    quad_init_snapshots(snapshots);
+}
+
+/**
+ * Returns the entity under the centre of point when the snapshot was taken,
+ * or NULL if there was none.
+ */
+Entity *quad_snapshot_find_entity(const QuadSnapshot *snapshot, SDL_Rect point)
+{
+    if (!snapshot)
+        return NULL;
+
+    SDL_Point p = get_rect_centre(point);
+    QuadFlatSearch search;
+    quad_flat_begin(&search, snapshot->nodes, snapshot->node_count, snapshot->margin);
+
+    const QuadSnapNode *node;
+    while ((node = quad_flat_next_point(&search, p)))
+    {
+        for (uint32_t i = node->first; i < node->first + node->count; i++)
+        {
+            if (is_collision(p.x, p.y, snapshot->entries[i].position))
+                return snapshot->entries[i].entity;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Visit every entity that overlapped rect when the snapshot was taken,
+ * returns the number visited.
+ */
+size_t quad_snapshot_visit_rect(const QuadSnapshot *snapshot, SDL_Rect rect, QuadVisitor visit,
+                                void *data)
+{
+    if (!snapshot)
+        return 0;
+
+    size_t count = 0;
+    QuadFlatSearch search;
+    quad_flat_begin(&search, snapshot->nodes, snapshot->node_count, snapshot->margin);
+
+    const QuadSnapNode *node;
+    while ((node = quad_flat_next_rect(&search, rect)))
+    {
+        for (uint32_t i = node->first; i < node->first + node->count; i++)
+        {
+            if (!is_overlap(rect, snapshot->entries[i].position))
+                continue;
+            count++;
+            if (!visit(snapshot->entries[i].entity, data))
+                return count;
+        }
+    }
+    return count;
+}
+
+/**
+ * Collect up to maximum entities that overlapped rect when the snapshot was
+ * taken, returns the number written to found.
+ */
+size_t quad_snapshot_query_rect(const QuadSnapshot *snapshot, SDL_Rect rect, Entity **found,
+                                size_t maximum)
+{
+    if (maximum == 0)
+        return 0;
+
+    QuadBuffer buffer = {.found = found, .count = 0, .maximum = maximum};
+    quad_snapshot_visit_rect(snapshot, rect, &quad_buffer_entity, &buffer);
+    return buffer.count;
+}
+
+/**
+ * Collect the k entities whose centres were closest to point when the
+ * snapshot was taken, nearest first. Returns the number written to found.
+ */
+size_t quad_snapshot_query_knn(const QuadSnapshot *snapshot, SDL_Point point, size_t k,
+                               Entity **found)
+{
+    if (!snapshot || k == 0 || snapshot->entry_count == 0)
+        return 0;
+    if (k > snapshot->entry_count)
+        k = snapshot->entry_count;
+
+    QuadNearest nearest;
+    if (!quad_nearest_init(&nearest, k))
+        return 0;
+
+    QuadQueue queue;
+    quad_queue_init(&queue);
+    quad_queue_push(&queue, (QuadQueued){.distance = 0, .node.index = 0});
+
+    while (queue.count > 0)
+    {
+        QuadQueued next = quad_queue_pop(&queue);
+        // Everything left is further than the furthest we are keeping.
+        if (!quad_nearest_wants(&nearest, next.distance))
+            break;
+
+        const QuadSnapNode *node = &snapshot->nodes[next.node.index];
+        for (uint32_t i = node->first; i < node->first + node->count; i++)
+            quad_nearest_offer(&nearest, snapshot->entries[i].entity,
+                               quad_distance_to_centre(snapshot->entries[i].position, point));
+
+        if (!node->children)
+            continue;
+        for (Quadrent q = 0; q < QUADRENTS; q++)
+        {
+            const QuadSnapNode *child = &snapshot->nodes[node->children + q];
+            int64_t distance = quad_distance_to_rect(child->bounds, point);
+            if (child->total == 0 || !quad_nearest_wants(&nearest, distance))
+                continue;
+            if (!quad_queue_push(&queue, (QuadQueued){.distance = distance,
+                                                      .node.index = node->children + q}))
+                break;
+        }
+    }
+
+    quad_queue_free(&queue);
+    return quad_nearest_finish(&nearest, found);
+}
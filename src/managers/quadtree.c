@@ -1,48 +1,297 @@
 #include <SDL2/SDL.h>
 
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <limits.h>
 
 #include "../../include/managers/quadtree.h"
+#include "../../include/managers/quadwalk.h"
+#include "../../include/managers/quadlanes.h"
 #include "../../include/entities/entity.h"
 #include "../../include/util/camera.h"
 
 #include "../../include/debug.h"
 
+// Levels of quadrents encoded in a spatial key.
+#define QUAD_KEY_DEPTH 16
+
+/**
+ * An entity tagged with the path of quadrents leading to it.
+ */
+typedef struct QuadKey
+{
+    uint32_t key;
+    Entity *entity;
+} QuadKey;
+
+// Levels of the key entities are partitioned by for a parallel build.
+#define QUAD_PARTITION_DEPTH 4
+#define QUAD_PARTITIONS (1 << (2 * QUAD_PARTITION_DEPTH))
+// Most threads a parallel build will run on.
+#define QUAD_MAX_WORKERS 64
+// Fewer entities per worker than this are built on the calling thread.
+#define QUAD_PARALLEL_MINIMUM 4096
+
+// Nodes a compaction visits before checking its budget, more than any path
+// holds so every call finishes at least one.
+#define QUAD_COMPACT_MINIMUM (QUAD_WALK_DEPTH + 2)
+
+/**
+ * A subtree for a worker to build from a run of keys.
+ */
+typedef struct QuadTask
+{
+    QuadTreeNode *node;
+    size_t start;
+    size_t count;
+    int depth;
+} QuadTask;
+
+/**
+ * A node waiting on a build or merge and the run of keys sorted below it.
+ */
+typedef struct QuadKeyRun
+{
+    QuadTreeNode *node;
+    QuadKey *keys;
+    size_t count;
+    int depth;
+} QuadKeyRun;
+
+/**
+ * A node waiting to be planned and the partitions it covers.
+ */
+typedef struct QuadPlanned
+{
+    QuadTreeNode *node;
+    size_t first;
+    size_t span;
+    int depth;
+} QuadPlanned;
+
+/**
+ * Work shared by the threads of a parallel build.
+ */
+typedef struct QuadBuild
+{
+    Entity **entities;
+    size_t count;
+    QuadKey *keys;
+    QuadKey *scratch;
+    QuadTask tasks[QUAD_PARTITIONS];
+    size_t task_count;
+    int workers;
+    // Index of the next task to claim.
+    SDL_atomic_t next;
+} QuadBuild;
+
+/**
+ * A thread of a parallel build and the nodes it has allocated.
+ */
+typedef struct QuadWorker
+{
+    QuadBuild *build;
+    QuadTree *tree;
+    int index;
+    QuadNodePool pool;
+    // Splits and spills made by this worker, added to the tree's after the build.
+    QuadCounters counters;
+    SDL_Thread *thread;
+} QuadWorker;
+
+/**
+ * The state of a walk searching for an entity under a point.
+ */
+typedef struct QuadPointSearch
+{
+    QuadTreeNode *start;
+    SDL_Point point;
+    QuadTreeNode *holder;
+    uint16_t index;
+    // Children holding the point at each depth on the way down.
+    unsigned held[QUAD_WALK_DEPTH + 1];
+} QuadPointSearch;
+
+/**
+ * The state of a walk collecting entities into a bucket.
+ */
+typedef struct QuadGathering
+{
+    Entity **bucket;
+    uint16_t count;
+} QuadGathering;
+
+/**
+ * The state of a compaction working through the dirty parts of a tree.
+ */
+typedef struct QuadCompaction
+{
+    // Performance counter to stop at, 0 for no limit.
+    Uint64 deadline;
+    // Nodes visited so far.
+    uint32_t visited;
+} QuadCompaction;
+
+/**
+ * The state of a walk looking for the largest node inside a view.
+ */
+typedef struct QuadViewSearch
+{
+    SDL_Rect view;
+    QuadTreeNode *found;
+} QuadViewSearch;
+
 // ---------------- Helper functions ----------------
 
 /**
- * Create a node.
+ * Scale bounds about their centre by the looseness of the tree.
+ */
+static SDL_Rect quad_loosen(SDL_Rect bounds, float looseness)
+{
+    if (looseness <= 1.0f)
+        return bounds;
+
+    int w = bounds.w * looseness;
+    int h = bounds.h * looseness;
+    return (SDL_Rect){.x = bounds.x - (w - bounds.w) / 2,
+                      .y = bounds.y - (h - bounds.h) / 2,
+                      .w = w,
+                      .h = h};
+}
+
+/**
+ * Initialize a node, its bucket must already be allocated.
  */
-static QuadTreeNode *quad_init_node(QuadTreeNode *parent, SDL_Rect bounds)
+static void quad_init_node(QuadTreeNode *node, QuadTree *tree, QuadTreeNode *parent,
+                           SDL_Rect bounds)
 {
-    // Allocate the root node.
-    QuadTreeNode *node = (QuadTreeNode *)malloc(sizeof(QuadTreeNode));
     node->parent = parent;
+    node->tree = tree;
+    node->depth = parent ? parent->depth + 1 : 0;
 
     // Children nodes.
     for (Quadrent q = 0; q < QUADRENTS; q++)
         node->children[q] = NULL;
 
-    node->entity = NULL;
+    // Empty bucket.
+    node->room = tree->capacity;
+    node->count = 0;
+    node->total = 0;
+    node->dirty = false;
 
     // Set the bounds.
     node->bounds = bounds;
-    return node;
+    node->loose = quad_loosen(bounds, tree->looseness);
 }
 
 /**
- * Free a node.
+ * Make space for size entities in a node, spilling its bucket onto the heap
+ * past the capacity of the tree. The spill is counted in counters.
  */
-static void quad_free_node(QuadTreeNode *node)
+static bool quad_reserve(QuadTreeNode *node, uint32_t size, QuadCounters *counters)
 {
-    for (Quadrent q = 0; q < QUADRENTS; q++)
+    if (size <= node->room)
+        return true;
+
+    if (size > UINT16_MAX)
+    {
+        ERROR_LOG("Node (%d %d %d %d) can not hold more than %d entities!\n", node->bounds.x,
+                  node->bounds.y, node->bounds.w, node->bounds.h, UINT16_MAX);
+        return false;
+    }
+
+    uint32_t room = node->room * 2 > size ? node->room * 2 : size;
+    if (room > UINT16_MAX)
+        room = UINT16_MAX;
+
+    bool spilled = node->entities != node->bucket;
+    Entity **entities = (Entity **)realloc(spilled ? node->entities : NULL,
+                                           sizeof(Entity *) * room);
+    if (!entities)
+    {
+        ERROR_LOG("Unable to spill node (%d %d %d %d) to %u entities!\n", node->bounds.x,
+                  node->bounds.y, node->bounds.w, node->bounds.h, room);
+        return false;
+    }
+    if (!spilled)
+    {
+        memcpy(entities, node->bucket, sizeof(Entity *) * node->count);
+        counters->spilled++;
+        counters->spilled_bytes += sizeof(Entity *) * room;
+    }
+    else
+    {
+        counters->spilled_bytes += sizeof(Entity *) * (room - node->room);
+    }
+
+    node->entities = entities;
+    node->room = room;
+    return true;
+}
+
+/**
+ * Move a spilled node back into its bucket once everything fits again.
+ */
+static void quad_unspill(QuadTreeNode *node)
+{
+    if (node->entities == node->bucket || node->count > node->tree->capacity)
+        return;
+
+    memcpy(node->bucket, node->entities, sizeof(Entity *) * node->count);
+    free(node->entities);
+    node->tree->counters.spilled--;
+    node->tree->counters.spilled_bytes -= sizeof(Entity *) * node->room;
+    node->entities = node->bucket;
+    node->room = node->tree->capacity;
+}
+
+/**
+ * Drop whatever a node holds, along with any spilled bucket.
+ */
+static void quad_empty(QuadTreeNode *node)
+{
+    if (node->entities != node->bucket)
     {
-        if (node->children[q])
-            quad_free_node(node->children[q]);
+        free(node->entities);
+        node->tree->counters.spilled--;
+        node->tree->counters.spilled_bytes -= sizeof(Entity *) * node->room;
     }
+    node->entities = node->bucket;
+    node->room = node->tree->capacity;
+    node->count = 0;
+    node->total = 0;
+}
+
+/**
+ * Release the children of a node back to the pool, they are visited first
+ * so theirs are already gone.
+ */
+static QuadWalkAction quad_release_block(QuadTreeNode *node, void *data)
+{
+    if (!node->children[TOPLEFT])
+        return QUAD_WALK_CONTINUE;
+
+    for (Quadrent q = 0; q < QUADRENTS; q++)
+        quad_empty(node->children[q]);
+
+    // The children were allocated as one block.
+    quad_pool_release(&node->tree->pool, node->children[TOPLEFT]);
+    for (Quadrent q = 0; q < QUADRENTS; q++)
+        node->children[q] = NULL;
+
+    node->tree->counters.branches--;
+    node->tree->counters.depths[node->depth + 1] -= QUADRENTS;
+    node->tree->counters.scattered++;
+    return QUAD_WALK_CONTINUE;
+}
 
-    free(node);
+/**
+ * Release the children of a node, and all of theirs, back to the pool.
+ */
+static void quad_release_children(QuadTreeNode *node)
+{
+    quad_walk(node, NULL, quad_release_block, NULL);
 }
 
 /**
@@ -57,268 +306,1637 @@ static inline bool quad_is_leaf(QuadTreeNode *node)
 }
 
 /**
- * Is this node a leaf and occupied?
+ * Can this node be split any further within the limits of the tree?
  */
-static inline bool quad_is_occupied(QuadTreeNode *node)
+static inline bool quad_can_subdivide(QuadTreeNode *node)
 {
-    if (!node || !node->entity)
-        return false;
+    return node->depth < node->tree->max_depth &&
+           node->bounds.w / 2 >= node->tree->min_size &&
+           node->bounds.h / 2 >= node->tree->min_size;
+}
+
+/**
+ * Does the node hold the point? Children split their parent's bounds half
+ * open, while the root only accepts points is_point_inside would.
+ */
+static inline bool quad_holds_point(QuadTreeNode *node, SDL_Point point)
+{
+    if (!node->parent)
+        return is_point_inside(node->bounds, point);
 
-    return quad_is_leaf(node);
+    return point.x >= node->bounds.x && point.x < node->bounds.x + node->bounds.w &&
+           point.y >= node->bounds.y && point.y < node->bounds.y + node->bounds.h;
 }
 
 /**
- * Turn a leaf into a branch and relocate the entity.
+ * Can the entity centred on point be stored at or below node? Outside of
+ * loose mode the centre is all that matters, the root takes anything whose
+ * centre it holds.
  */
-static void quad_subdivide(QuadTreeNode *node)
+static inline bool quad_fits(QuadTreeNode *node, Entity *entity, SDL_Point point)
 {
-    SDL_Point centre = get_rect_centre(node->bounds);
-    SDL_Rect bounds = node->bounds;
+    if (!quad_holds_point(node, point))
+        return false;
 
-    // Create the children.
-    node->children[TOPLEFT] =
-        quad_init_node(node,
-                       (SDL_Rect){.x = bounds.x, .y = bounds.y, .w = bounds.w / 2, .h = bounds.h / 2});
-    node->children[TOPRIGHT] = quad_init_node(node, (SDL_Rect){.x = bounds.x + (bounds.w / 2), .y = node->bounds.y, .w = bounds.w / 2, .h = bounds.h / 2});
-    node->children[BOTLEFT] = quad_init_node(node, (SDL_Rect){.x = bounds.x, .y = node->bounds.y + (bounds.h / 2), .w = bounds.w / 2, .h = bounds.h / 2});
-    node->children[BOTRIGHT] = quad_init_node(node, (SDL_Rect){.x = bounds.x + (bounds.w / 2), .y = node->bounds.y + (bounds.h / 2), .w = bounds.w / 2, .h = bounds.h / 2});
+    return node->tree->looseness <= 1.0f || !node->parent ||
+           is_inside(node->loose, entity->position);
+}
+
+/**
+ * Check the bucket of a node for an entity under the point, leaving out
+ * subtrees whose loose bounds, grown by the margin, do not hold it as found
+ * by the parent's lanes.
+ */
+static QuadWalkAction quad_search_point(QuadTreeNode *node, void *data)
+{
+    QuadPointSearch *search = (QuadPointSearch *)data;
+    // Children are one block, so their offset is their quadrent.
+    if (node != search->start &&
+        (node->total == 0 || !(search->held[node->parent->depth] &
+                               (1u << (node - node->parent->children[TOPLEFT])))))
+        return QUAD_WALK_SKIP;
 
-    // Push the old entity down. if there is one.
-    if (node && node->entity)
+    for (uint16_t i = 0; i < node->count; i++)
     {
-        SDL_Point point = get_rect_centre(node->entity->position);
-        Quadrent q = get_dir(centre, point);
-        node->children[q]->entity = node->entity;
-        node->entity = NULL;
+        if (is_collision(search->point.x, search->point.y, node->entities[i]->position))
+        {
+            search->holder = node;
+            search->index = i;
+            return QUAD_WALK_STOP;
+        }
     }
+
+    // Entities can hang out of their node by the margin, so the children must
+    // hold the point once grown by it.
+    int margin = quad_margin(node->tree);
+    if (node->children[TOPLEFT] && margin == 0)
+        search->held[node->depth] = quad_lanes_hold(&node->lanes, search->point);
+    else if (node->children[TOPLEFT])
+        search->held[node->depth] = quad_lanes_overlap(
+            &node->lanes,
+            (SDL_Rect){.x = search->point.x - margin - 1,
+                       .y = search->point.y - margin - 1,
+                       .w = 2 * margin + 2,
+                       .h = 2 * margin + 2},
+            NULL);
+    return QUAD_WALK_CONTINUE;
 }
 
 /**
- * Restore a node when there is only one or no entities.
- * Turns branch into a leaf.
+ * Find the node and bucket index of an entity under point, checking every
+ * node whose loose bounds hold the point.
  */
-static void quad_restore(QuadTreeNode *node)
+static bool quad_find_at(QuadTreeNode *node, SDL_Point point, QuadTreeNode **holder,
+                         uint16_t *index)
+{
+    QuadPointSearch search = {.start = node, .point = point, .holder = NULL, .index = 0};
+    quad_walk(node, quad_search_point, NULL, &search);
+    if (!search.holder)
+        return false;
+
+    *holder = search.holder;
+    *index = search.index;
+    return true;
+}
+
+/**
+ * Find the node and bucket index of an entity placed by its centre at point,
+ * searching the path of the point below node and then the ancestors of node.
+ */
+static bool quad_find_holder(QuadTreeNode *node, Entity *entity, SDL_Point point,
+                             QuadTreeNode **holder, uint16_t *index)
 {
-    Entity *j = NULL;
-    // Find our entity to pull up.
-    for (int q = 0; q < QUADRENTS; q++)
+    // Down the path of the point first.
+    QuadTreeNode *n = node;
+    for (;;)
     {
-        if (node->children[q]->entity != NULL)
+        for (uint16_t i = 0; i < n->count; i++)
         {
-            if (j != NULL)
+            if (n->entities[i] == entity)
             {
-                return;
+                *holder = n;
+                *index = i;
+                return true;
             }
-            j = node->children[q]->entity;
         }
+        if (quad_is_leaf(n))
+            break;
+        n = n->children[get_dir(get_rect_centre(n->bounds), point)];
     }
-    // Free the child nodes.
-    for (Quadrent q = 0; q < QUADRENTS; q++)
+
+    // Then back up above where we started.
+    for (n = node->parent; n; n = n->parent)
     {
-        quad_free_node(node->children[q]);
-        node->children[q] = NULL;
+        for (uint16_t i = 0; i < n->count; i++)
+        {
+            if (n->entities[i] == entity)
+            {
+                *holder = n;
+                *index = i;
+                return true;
+            }
+        }
     }
-    // Set the entity.
-    node->entity = j;
+    return false;
 }
 
-// ---------------- Main functions ----------------
-
 /**
- * Initialize the quad tree node.
+ * Append the bucket of a node to the gathering.
  */
-void quad_init_tree(QuadTree *quad, SDL_Rect bounds)
+static QuadWalkAction quad_gather_bucket(QuadTreeNode *node, void *data)
 {
-    // Size of the quad tree.
-    quad->size = 0;
-
-    // Initialize the root node.
-    quad->root = (QuadTreeNode *)malloc(sizeof(QuadTreeNode));
-    quad->root->parent = NULL;
-
-    // Children nodes.
-    for (Quadrent q = 0; q < QUADRENTS; q++)
-        quad->root->children[q] = NULL;
-
-    quad->root->entity = NULL;
-
-    // Set the bounds.
-    quad->root->bounds = bounds;
+    QuadGathering *gathering = (QuadGathering *)data;
+    for (uint16_t i = 0; i < node->count; i++)
+        gathering->bucket[gathering->count++] = node->entities[i];
+    return QUAD_WALK_CONTINUE;
 }
 
 /**
- * Free quad tree.
+ * Collect every entity stored below node into the bucket provided.
  */
-void quad_free_tree(QuadTree *quad)
+static uint16_t quad_gather(QuadTreeNode *node, Entity **bucket, uint16_t count)
 {
-    quad_free_node(quad->root);
+    QuadGathering gathering = {.bucket = bucket, .count = count};
+    quad_walk(node, quad_gather_bucket, NULL, &gathering);
+    return gathering.count;
 }
 
 /**
- * Returns the pointer to the largest node that falls within the provided
- * rectangle.
+ * Get the bounds of a quadrent of the provided bounds.
  */
-QuadTreeNode *quad_find_node(QuadTreeNode *node, SDL_Rect view)
+static SDL_Rect quad_child_bounds(SDL_Rect bounds, Quadrent q)
 {
-    // Does this node exist?
-    if (!node)
-        return NULL;
+    SDL_Point centre = get_rect_centre(bounds);
+    // The right and bottom halves keep the odd pixel.
+    int left = centre.x - bounds.x;
+    int top = centre.y - bounds.y;
 
-    DEBUG_LOG("Checking node %p\n", (void *)node);
-
-    // Is this node inside? If so we return the parent.
-    if (is_inside(view, node->bounds))
+    switch (q)
     {
-        DEBUG_LOG("quad (%d %d %d %d) is outside view %d %d %d %d\n", node->bounds.x, node->bounds.y,
-                  node->bounds.w, node->bounds.h, view.x, view.y, view.w, view.h);
-        return node->parent;
+    case TOPLEFT:
+        return (SDL_Rect){.x = bounds.x, .y = bounds.y, .w = left, .h = top};
+    case TOPRIGHT:
+        return (SDL_Rect){.x = centre.x, .y = bounds.y, .w = bounds.w - left, .h = top};
+    case BOTLEFT:
+        return (SDL_Rect){.x = bounds.x, .y = centre.y, .w = left, .h = bounds.h - top};
+    default:
+        return (SDL_Rect){.x = centre.x, .y = centre.y, .w = bounds.w - left, .h = bounds.h - top};
     }
+}
+
+/**
+ * Turn a full leaf into a branch and relocate its bucket into the children,
+ * which are allocated from pool. The split is counted in counters.
+ */
+static bool quad_subdivide(QuadTreeNode *node, QuadNodePool *pool, QuadCounters *counters)
+{
+    SDL_Point centre = get_rect_centre(node->bounds);
+
+    // Create the children.
+    QuadTreeNode *block = quad_pool_alloc(pool);
+    if (!block)
+        return false;
 
-    // Check our children to see if any contain the view.
     for (Quadrent q = 0; q < QUADRENTS; q++)
     {
-        QuadTreeNode *selected = quad_find_node(node->children[q], view);
-        if (selected)
-            return selected;
+        quad_init_node(&block[q], node->tree, node, quad_child_bounds(node->bounds, q));
+        node->children[q] = &block[q];
     }
+    quad_lanes_set(node);
+    counters->branches++;
+    counters->depths[node->depth + 1] += QUADRENTS;
+    counters->splits++;
+    counters->scattered++;
 
-    return NULL;
+    // Push the old entities down, in loose mode some may be too big to move.
+    uint16_t kept = 0;
+    for (uint16_t i = 0; i < node->count; i++)
+    {
+        Entity *entity = node->entities[i];
+        SDL_Point point = get_rect_centre(entity->position);
+        QuadTreeNode *child = node->children[get_dir(centre, point)];
+        if (!quad_fits(child, entity, point))
+        {
+            node->entities[kept++] = entity;
+            continue;
+        }
+        child->entities[child->count++] = entity;
+        child->total++;
+    }
+    node->count = kept;
+    return true;
 }
 
 /**
- * Does this node have any children?
- * Returns the pointer to stored entity on success, and NULL
- * if no entity was found.
+ * Restore a branch when its subtree has dropped below the merge threshold.
+ * Turns branch into a leaf holding all the entities of its subtree.
  */
-QuadTreeNode *quad_find_entity(QuadTreeNode *node, SDL_Rect point)
+static void quad_restore(QuadTreeNode *node)
 {
-    // Does this node exist?
-    if (!node)
-        return NULL;
+    // Pull all our entities up.
+    for (Quadrent q = 0; q < QUADRENTS; q++)
+        node->count = quad_gather(node->children[q], node->entities, node->count);
 
-    // Is this a leaf?
-    if (quad_is_occupied(node))
-        return node;
+    // Recycle the child nodes.
+    quad_release_children(node);
+    node->tree->counters.merges++;
+}
 
-    // Where do we search next?
-    SDL_Point centre = get_rect_centre(node->bounds);
-    SDL_Point p = get_rect_centre(point);
+/**
+ * Track the deepest node of a subtree.
+ */
+static QuadWalkAction quad_measure_depth(QuadTreeNode *node, void *data)
+{
+    uint8_t *deepest = (uint8_t *)data;
+    if (node->depth > *deepest)
+        *deepest = node->depth;
+    return QUAD_WALK_CONTINUE;
+}
 
-    // Get direction.
-    Quadrent q = get_dir(centre, p);
-    switch (q)
-    {
-    case QUADRENTS:
-        // No direction.
-        return NULL;
-    case TOPLEFT:
-        if (node->children[TOPLEFT] != NULL)
-            quad_find_entity(node->children[TOPLEFT], point);
-        break;
-    case TOPRIGHT:
-        if (node->children[TOPRIGHT] != NULL)
-            quad_find_entity(node->children[TOPRIGHT], point);
-        break;
-    case BOTLEFT:
-        if (node->children[BOTLEFT] != NULL)
-            quad_find_entity(node->children[BOTLEFT], point);
-        break;
-    case BOTRIGHT:
-        if (node->children[BOTRIGHT] != NULL)
-            quad_find_entity(node->children[BOTRIGHT], point);
-        break;
-    }
-    return NULL;
+/**
+ * Move a node one level further from the root.
+ */
+static QuadWalkAction quad_deepen(QuadTreeNode *node, void *data)
+{
+    node->depth++;
+    return QUAD_WALK_CONTINUE;
 }
 
 /**
- * Insert an entity into the quad tree.
+ * Double the root towards point until it is inside, the old root becomes one
+ * of the children of the new one. The root keeps its address, its contents
+ * move into the child, so no entity is placed again. Returns false if the
+ * tree would be too deep or too wide.
  */
-bool quad_insert_entity(QuadTreeNode *node, Entity *entity)
+static bool quad_grow(QuadTree *quad, SDL_Point point)
 {
-    if (!node)
-        ERROR_LOG("Called on a null node!\n");
+    QuadTreeNode *root = quad->root;
+    while (!is_point_inside(root->bounds, point))
+    {
+        // Every node moves down a level.
+        uint8_t deepest = 0;
+        quad_walk(root, quad_measure_depth, NULL, &deepest);
+        if (deepest >= QUAD_WALK_DEPTH)
+        {
+            ERROR_LOG("Quad tree is too deep to grow towards (%d %d)!\n", point.x, point.y);
+            return false;
+        }
 
-    if (!is_point_inside(node->bounds, get_rect_centre(entity->position)))
-        return false;
+        // Grow left and up when the point is that way, the old root takes the opposite corner.
+        SDL_Rect bounds = root->bounds;
+        bool left = point.x <= bounds.x;
+        bool up = point.y <= bounds.y;
+        int64_t x = left ? (int64_t)bounds.x - bounds.w : bounds.x;
+        int64_t y = up ? (int64_t)bounds.y - bounds.h : bounds.y;
+        if (x < INT_MIN || y < INT_MIN || x + 2 * (int64_t)bounds.w > INT_MAX ||
+            y + 2 * (int64_t)bounds.h > INT_MAX)
+        {
+            ERROR_LOG("Quad tree is too wide to grow towards (%d %d)!\n", point.x, point.y);
+            return false;
+        }
+        SDL_Rect grown = {.x = (int)x, .y = (int)y, .w = bounds.w * 2, .h = bounds.h * 2};
+        Quadrent old = left ? (up ? BOTRIGHT : TOPRIGHT) : (up ? BOTLEFT : TOPLEFT);
 
-    // Do we have space in the current node to add entity?
-    if (quad_is_leaf(node) && node->entity == NULL)
-    {
-        // Place entity and return.
-        node->entity = entity;
-        return true;
-    }
-    // Are we on a branch or a leaf?
-    if (quad_is_leaf(node))
-    {
-        quad_subdivide(node);
-        return quad_insert_entity(node, entity);
-    }
+        // An empty leaf has nothing to move into a child, it just widens.
+        bool empty = quad_is_leaf(root) && root->count == 0;
+        QuadTreeNode *block = empty ? NULL : quad_pool_alloc(&quad->pool);
+        if (!empty && !block)
+            return false;
 
-    // We can try and find a place to put the entity.
-    Quadrent q = get_dir(get_rect_centre(node->bounds),
-                         get_rect_centre(entity->position));
-    switch (q)
-    {
-    case TOPLEFT:
-        if (!node->children[TOPLEFT]->entity)
-            quad_init_node(node, (SDL_Rect){.x = node->bounds.x, .y = node->bounds.y, .w = node->bounds.w / 2, .h = node->bounds.h / 2});
+        // Keep the smallest node the same size.
+        if (quad->max_depth < QUAD_WALK_DEPTH)
+            quad->max_depth++;
+        if (empty)
+        {
+            root->bounds = grown;
+            root->loose = quad_loosen(grown, quad->looseness);
+            continue;
+        }
+        for (Quadrent q = 0; q < QUADRENTS; q++)
+            quad_init_node(&block[q], quad, root, quad_child_bounds(grown, q));
 
-        return quad_insert_entity(node->children[TOPLEFT], entity);
-    case TOPRIGHT:
-        if (!node->children[TOPRIGHT]->entity)
-            quad_init_node(node, (SDL_Rect){.x = node->bounds.x + (node->bounds.w / 2), .y = node->bounds.y, .w = node->bounds.w / 2, .h = node->bounds.h / 2});
+        // Every level moves down one, under a new root with three new children.
+        QuadCounters *counters = &quad->counters;
+        memmove(counters->depths + 1, counters->depths, sizeof(uint32_t) * QUAD_WALK_DEPTH);
+        counters->depths[0] = 1;
+        counters->depths[1] += QUADRENTS - 1;
+        counters->branches++;
+        counters->scattered++;
 
-        return quad_insert_entity(node->children[TOPRIGHT], entity);
-    case BOTLEFT:
-        if (!node->children[BOTLEFT]->entity)
-            quad_init_node(node, (SDL_Rect){.x = node->bounds.x, .y = node->bounds.y + (node->bounds.h / 2), .w = node->bounds.w / 2, .h = node->bounds.h / 2});
+        // Move the old root into its corner, an inline bucket is copied over.
+        QuadTreeNode *moved = &block[old];
+        if (root->entities == root->bucket)
+        {
+            memcpy(moved->bucket, root->bucket, sizeof(Entity *) * root->count);
+        }
+        else
+        {
+            moved->entities = root->entities;
+            moved->room = root->room;
+        }
+        moved->count = root->count;
+        moved->total = root->total;
+        moved->lanes = root->lanes;
+        moved->dirty = root->dirty;
+        for (Quadrent q = 0; q < QUADRENTS; q++)
+        {
+            moved->children[q] = root->children[q];
+            if (moved->children[q])
+                moved->children[q]->parent = moved;
+        }
+        for (Quadrent q = 0; q < QUADRENTS; q++)
+        {
+            if (moved->children[q])
+                quad_walk(moved->children[q], quad_deepen, NULL, NULL);
+        }
 
-        return quad_insert_entity(node->children[BOTLEFT], entity);
-    case BOTRIGHT:
-        if (!node->children[BOTRIGHT]->entity)
-            quad_init_node(node, (SDL_Rect){.x = node->bounds.x + (node->bounds.w / 2), .y = node->bounds.y + (node->bounds.h / 2), .w = node->bounds.w / 2, .h = node->bounds.h / 2});
+        // The root is the new parent.
+        root->bounds = grown;
+        root->loose = quad_loosen(grown, quad->looseness);
+        root->entities = root->bucket;
+        root->room = quad->capacity;
+        root->count = 0;
+        for (Quadrent q = 0; q < QUADRENTS; q++)
+            root->children[q] = &block[q];
+        quad_lanes_set(root);
 
-        return quad_insert_entity(node->children[BOTRIGHT], entity);
-    default:
-        break;
+        // Only the root may hold entities larger than its loose bounds.
+        uint16_t kept = 0;
+        for (uint16_t i = 0; i < moved->count; i++)
+        {
+            Entity *entity = moved->entities[i];
+            if (!quad_fits(moved, entity, get_rect_centre(entity->position)) &&
+                quad_reserve(root, root->count + 1, counters))
+            {
+                root->entities[root->count++] = entity;
+                moved->total--;
+                continue;
+            }
+            moved->entities[kept++] = entity;
+        }
+        moved->count = kept;
+        quad_unspill(moved);
     }
+    return true;
+}
 
-    return false;
+/**
+ * Widen how far entities reach past their centre to cover position.
+ */
+static inline void quad_widen_reach(QuadTree *quad, SDL_Rect position)
+{
+    // The centre rounds down, so the right and bottom reach further.
+    int reach = SDL_max(position.w - position.w / 2, position.h - position.h / 2);
+    if (reach > quad->reach)
+        quad->reach = reach;
 }
 
 /**
- * Remove an entity from the quad tree.
+ * Grow the root over the centre of every entity, and the reach over their
+ * extents.
  */
-bool quad_remove_entity(QuadTreeNode *node, SDL_Rect point)
+static bool quad_grow_over(QuadTree *quad, Entity **entities, size_t count)
 {
-    QuadTreeNode *found = quad_find_entity(node, point);
-    if (!found)
-        return false;
+    bool grown = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        quad_widen_reach(quad, entities[i]->position);
+        grown = quad_grow(quad, get_rect_centre(entities[i]->position)) && grown;
+    }
+    return grown;
+}
 
-    QuadTreeNode *foundParent = found->parent;
-    // Mark the entity for cleanup.
-    // If it has already not been marked for removal.
-    if (found->entity)
-        found->entity->remove = true;
+/**
+ * Key an entity by the quadrents it would descend through from bounds.
+ */
+static uint32_t quad_key(SDL_Rect bounds, Entity *entity)
+{
+    SDL_Point point = get_rect_centre(entity->position);
+    uint32_t key = 0;
+    for (int depth = 0; depth < QUAD_KEY_DEPTH; depth++)
+    {
+        Quadrent q = get_dir(get_rect_centre(bounds), point);
+        key = (key << 2) | q;
+        bounds = quad_child_bounds(bounds, q);
+    }
+    return key;
+}
 
-    // Clean up the node.
-    quad_free_node(node);
+/**
+ * Radix sort keys by their key, scratch must have space for count keys.
+ */
+static void quad_sort_keys(QuadKey *keys, QuadKey *scratch, size_t count)
+{
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        size_t offsets[256] = {0};
+        for (size_t i = 0; i < count; i++)
+            offsets[(keys[i].key >> shift) & 0xFF]++;
 
-    // Do we need to clean up the parent node?
-    if (foundParent == NULL)
-        return true;
+        size_t total = 0;
+        for (int digit = 0; digit < 256; digit++)
+        {
+            size_t size = offsets[digit];
+            offsets[digit] = total;
+            total += size;
+        }
 
-    int children = 0;
-    for (Quadrent q = 0; q < QUADRENTS; q++)
-    {
-        if (foundParent->children[q] != NULL)
-            children++;
+        for (size_t i = 0; i < count; i++)
+            scratch[offsets[(keys[i].key >> shift) & 0xFF]++] = keys[i];
+        memcpy(keys, scratch, sizeof(QuadKey) * count);
     }
-    // Need to restore the nodes.
-    if (children < 2)
-        quad_restore(foundParent);
+}
+
+/**
+ * Find the end of the run of sorted keys from start that descend into
+ * quadrent q at depth.
+ */
+static size_t quad_run_end(QuadKey *keys, size_t start, size_t count, int depth, Quadrent q)
+{
+    int shift = 2 * (QUAD_KEY_DEPTH - depth - 1);
+    size_t lo = start, hi = count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (((keys[mid].key >> shift) & 3) <= q)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * Fill the bucket of a leaf from keys, keeping what will not fit under the
+ * limits in a spilled bucket. Returns the number of entities placed.
+ */
+static uint32_t quad_fill_bucket(QuadTreeNode *node, QuadKey *keys, size_t count,
+                                 QuadCounters *counters)
+{
+    if (!quad_reserve(node, node->count + count, counters))
+        count = node->room - node->count;
+    for (size_t i = 0; i < count; i++)
+        node->entities[node->count++] = keys[i].entity;
+    return count;
+}
+
+/**
+ * Add to the total of node and every node above it up to and including stop.
+ */
+static void quad_add_total(QuadTreeNode *node, QuadTreeNode *stop, uint32_t amount)
+{
+    for (;; node = node->parent)
+    {
+        node->total += amount;
+        if (node == stop)
+            return;
+    }
+}
+
+/**
+ * Re-key a run of keys relative to node once they are out of key.
+ */
+static void quad_rekey(QuadTreeNode *node, QuadKey *keys, QuadKey *scratch, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        keys[i].key = quad_key(node->bounds, keys[i].entity);
+    quad_sort_keys(keys, scratch, count);
+}
+
+/**
+ * Push the runs of keys each child of node owns at depth, backwards so they
+ * come off the stack in quadrent order.
+ */
+static void quad_push_runs(QuadKeyRun *stack, int *top, QuadKeyRun run)
+{
+    size_t end = run.count;
+    for (int q = QUADRENTS - 1; q >= 0; q--)
+    {
+        size_t start = q > 0 ? quad_run_end(run.keys, 0, end, run.depth, q - 1) : 0;
+        stack[++*top] = (QuadKeyRun){.node = run.node->children[q],
+                                     .keys = run.keys + start,
+                                     .count = end - start,
+                                     .depth = run.depth + 1};
+        end = start;
+    }
+}
+
+/**
+ * Build the subtree under an empty leaf from keys sorted below it, with new
+ * nodes allocated from pool and counted in counters. Totals are kept up to
+ * and including node. Returns the number of entities placed.
+ */
+static uint32_t quad_build_node(QuadTreeNode *node, QuadKey *keys, QuadKey *scratch,
+                                size_t count, int depth, QuadNodePool *pool,
+                                QuadCounters *counters)
+{
+    QuadKeyRun stack[QUAD_WALK_STACK];
+    int top = 0;
+    stack[0] = (QuadKeyRun){.node = node, .keys = keys, .count = count, .depth = depth};
+    uint32_t placed = 0;
+    while (top >= 0)
+    {
+        QuadKeyRun run = stack[top--];
+        if (run.count == 0)
+            continue;
+
+        // Does everything fit in this bucket?
+        if (run.count > node->tree->capacity && quad_can_subdivide(run.node))
+        {
+            if (top + QUADRENTS < QUAD_WALK_STACK)
+            {
+                // Out of key, start again relative to this node.
+                if (run.depth == QUAD_KEY_DEPTH)
+                {
+                    quad_rekey(run.node, run.keys, scratch, run.count);
+                    run.depth = 0;
+                }
+
+                if (quad_subdivide(run.node, pool, counters))
+                    quad_push_runs(stack, &top, run);
+                continue;
+            }
+            ERROR_LOG("Quad tree deeper than %d levels, spilling a leaf!\n", QUAD_WALK_DEPTH);
+        }
+
+        // Past the limits, keep the rest in a spilled bucket.
+        uint32_t filled = quad_fill_bucket(run.node, run.keys, run.count, counters);
+        quad_add_total(run.node, node, filled);
+        placed += filled;
+    }
+    return placed;
+}
+
+/**
+ * Insert keys sorted below node into its existing subtree, a leaf that would
+ * overflow is rebuilt from its bucket and the keys together so it is split
+ * once. Combined and scratch need space for count keys and a full bucket.
+ * Returns how much the total of node grew by.
+ */
+static uint32_t quad_merge_keys(QuadTreeNode *node, QuadKey *keys, QuadKey *scratch,
+                                QuadKey *combined, size_t count, int depth)
+{
+    QuadKeyRun stack[QUAD_WALK_STACK];
+    int top = 0;
+    stack[0] = (QuadKeyRun){.node = node, .keys = keys, .count = count, .depth = depth};
+    uint32_t grown = 0;
+    while (top >= 0)
+    {
+        QuadKeyRun run = stack[top--];
+        QuadTreeNode *leaf = run.node;
+        if (run.count == 0)
+            continue;
+
+        if (!quad_is_leaf(leaf))
+        {
+            if (top + QUADRENTS >= QUAD_WALK_STACK)
+            {
+                ERROR_LOG("Quad tree deeper than %d levels, skipping a branch!\n",
+                          QUAD_WALK_DEPTH);
+                continue;
+            }
+
+            // Out of key, start again relative to this node.
+            if (run.depth == QUAD_KEY_DEPTH)
+            {
+                quad_rekey(leaf, run.keys, scratch, run.count);
+                run.depth = 0;
+            }
+            quad_push_runs(stack, &top, run);
+            continue;
+        }
+
+        // Room for all of them in the bucket, or nowhere else for them to go.
+        uint32_t added;
+        if (leaf->count + run.count <= leaf->tree->capacity || !quad_can_subdivide(leaf))
+        {
+            added = quad_fill_bucket(leaf, run.keys, run.count, &leaf->tree->counters);
+            leaf->total += added;
+        }
+        else
+        {
+            // Key the old and new entities relative to this leaf and build it again.
+            size_t size = 0;
+            for (uint16_t i = 0; i < leaf->count; i++)
+            {
+                combined[size].key = quad_key(leaf->bounds, leaf->entities[i]);
+                combined[size++].entity = leaf->entities[i];
+            }
+            for (size_t i = 0; i < run.count; i++)
+            {
+                combined[size].key = quad_key(leaf->bounds, run.keys[i].entity);
+                combined[size++].entity = run.keys[i].entity;
+            }
+            quad_sort_keys(combined, scratch, size);
+
+            uint32_t before = leaf->total;
+            leaf->count = 0;
+            leaf->total = 0;
+            added = quad_build_node(leaf, combined, scratch, size, 0, &leaf->tree->pool,
+                                    &leaf->tree->counters) -
+                    before;
+        }
+
+        // The leaf has its total, carry the growth up to node.
+        if (leaf != node)
+            quad_add_total(leaf->parent, node, added);
+        grown += added;
+    }
+    return grown;
+}
+
+/**
+ * Place an entity in the subtree under node, splitting any full leaf on the
+ * way. Totals are updated from the leaf up to, but not including, stop.
+ */
+static bool quad_place(QuadTreeNode *node, Entity *entity, SDL_Point point, QuadTreeNode *stop)
+{
+    quad_widen_reach(node->tree, entity->position);
+    for (;;)
+    {
+        // Go as deep as the entity fits.
+        if (!quad_is_leaf(node))
+        {
+            QuadTreeNode *child = node->children[get_dir(get_rect_centre(node->bounds), point)];
+            if (quad_fits(child, entity, point))
+            {
+                node = child;
+                continue;
+            }
+        }
+        if (node->count < node->room)
+            break;
+
+        // Split until the bucket we land in has space.
+        if (quad_is_leaf(node) && quad_can_subdivide(node))
+        {
+            if (!quad_subdivide(node, &node->tree->pool, &node->tree->counters))
+                return false;
+            continue;
+        }
+
+        // Nowhere left to split, spill the bucket.
+        if (!quad_reserve(node, node->count + 1, &node->tree->counters))
+            return false;
+        break;
+    }
+
+    // Place entity and account for it on the way back up.
+    node->entities[node->count++] = entity;
+    for (QuadTreeNode *n = node; n != stop; n = n->parent)
+        n->total++;
+
+    return true;
+}
+
+/**
+ * Take the entity at index out of the bucket of a node, leaving the totals.
+ * A lazy tree keeps a spilled bucket for compaction to give back.
+ */
+static void quad_take(QuadTreeNode *node, uint16_t index)
+{
+    // Fill the hole with the last entity in the bucket.
+    node->entities[index] = node->entities[--node->count];
+    if (!node->tree->lazy)
+        quad_unspill(node);
+}
+
+/**
+ * Take the entity at index out of a node, updating totals up to but not
+ * including stop and merging the highest branch below stop that has dropped
+ * under the threshold. A lazy tree marks the path dirty for quad_compact
+ * instead of merging.
+ */
+static void quad_detach(QuadTreeNode *holder, uint16_t index, QuadTreeNode *stop)
+{
+    quad_take(holder, index);
+
+    if (holder->tree->lazy)
+    {
+        for (QuadTreeNode *n = holder; n != stop; n = n->parent)
+            n->total--;
+        // Everything above a dirty node is already dirty.
+        for (QuadTreeNode *n = holder; n && !n->dirty; n = n->parent)
+            n->dirty = true;
+        return;
+    }
+
+    // Find the highest ancestor that has dropped below the threshold.
+    QuadTreeNode *merge = NULL;
+    for (QuadTreeNode *n = holder; n != stop; n = n->parent)
+    {
+        n->total--;
+        if (!quad_is_leaf(n) && n->total <= n->tree->merge_threshold)
+            merge = n;
+    }
+
+    // Need to restore the nodes.
+    if (merge)
+        quad_restore(merge);
+}
+
+/**
+ * Merge a branch a batch took entities out of if it has dropped under the
+ * threshold, only dirty subtrees are visited.
+ */
+static QuadWalkAction quad_collapse_node(QuadTreeNode *node, void *data)
+{
+    if (!node->dirty)
+        return QUAD_WALK_SKIP;
+    node->dirty = false;
+
+    if (!quad_is_leaf(node) && node->total <= node->tree->merge_threshold)
+    {
+        quad_restore(node);
+        return QUAD_WALK_SKIP;
+    }
+    return QUAD_WALK_CONTINUE;
+}
+
+/**
+ * Merge a dirty branch that has dropped under the threshold and give back a
+ * spilled bucket that fits again, stopping once the budget has run out.
+ */
+static QuadWalkAction quad_compact_node(QuadTreeNode *node, void *data)
+{
+    QuadCompaction *compaction = (QuadCompaction *)data;
+    if (!node->dirty)
+        return QUAD_WALK_SKIP;
+
+    if (compaction->deadline && ++compaction->visited > QUAD_COMPACT_MINIMUM &&
+        SDL_GetPerformanceCounter() >= compaction->deadline)
+        return QUAD_WALK_STOP;
+
+    if (!quad_is_leaf(node) && node->total <= node->tree->merge_threshold)
+    {
+        quad_restore(node);
+        quad_unspill(node);
+        return QUAD_WALK_SKIP;
+    }
+    quad_unspill(node);
+    return QUAD_WALK_CONTINUE;
+}
+
+/**
+ * Clean a node once everything below it has been compacted, a walk stopped
+ * early leaves it dirty for the next one.
+ */
+static QuadWalkAction quad_compact_done(QuadTreeNode *node, void *data)
+{
+    node->dirty = false;
+    return QUAD_WALK_CONTINUE;
+}
+
+/**
+ * Append an entity to one of the lists of a batch, growing it if needed.
+ */
+static bool quad_batch_push(Entity ***list, uint32_t *count, uint32_t *maximum, Entity *entity)
+{
+    if (*count == *maximum)
+    {
+        uint32_t maximum_new = *maximum ? *maximum * 2 : 16;
+        Entity **list_new = (Entity **)realloc(*list, sizeof(Entity *) * maximum_new);
+        if (!list_new)
+        {
+            ERROR_LOG("Unable to grow quad batch to %u entities!\n", maximum_new);
+            return false;
+        }
+        *list = list_new;
+        *maximum = maximum_new;
+    }
+    (*list)[(*count)++] = entity;
+    return true;
+}
+
+/**
+ * Move the children of a node into the next block of pool, the node itself
+ * has already been moved so the walk carries on into the copies.
+ */
+static QuadWalkAction quad_relayout_block(QuadTreeNode *node, void *data)
+{
+    if (!node->children[TOPLEFT])
+        return QUAD_WALK_CONTINUE;
+
+    // Reserved up front, so this can not fail.
+    QuadNodePool *pool = (QuadNodePool *)data;
+    QuadTreeNode *block = quad_pool_alloc(pool);
+    Entity **buckets[QUADRENTS];
+    for (Quadrent q = 0; q < QUADRENTS; q++)
+        buckets[q] = block[q].bucket;
+    memcpy(block, node->children[TOPLEFT], pool->block_size);
+
+    for (Quadrent q = 0; q < QUADRENTS; q++)
+    {
+        // Inline buckets moved with the block, spilled ones stay where they are.
+        if (block[q].entities == block[q].bucket)
+            block[q].entities = buckets[q];
+        block[q].bucket = buckets[q];
+        block[q].parent = node;
+        node->children[q] = &block[q];
+    }
+    return QUAD_WALK_CONTINUE;
+}
+
+/**
+ * Stop at the first node inside the view, settling on its parent.
+ */
+static QuadWalkAction quad_search_view(QuadTreeNode *node, void *data)
+{
+    QuadViewSearch *search = (QuadViewSearch *)data;
+    DEBUG_LOG("Checking node %p\n", (void *)node);
+
+    // Is this node inside? If so we return the parent.
+    if (is_inside(search->view, node->bounds))
+    {
+        DEBUG_LOG("quad (%d %d %d %d) is outside view %d %d %d %d\n", node->bounds.x,
+                  node->bounds.y, node->bounds.w, node->bounds.h, search->view.x,
+                  search->view.y, search->view.w, search->view.h);
+        search->found = node->parent;
+        return QUAD_WALK_STOP;
+    }
+    return QUAD_WALK_CONTINUE;
+}
+
+/**
+ * Key a worker's share of the entities, those outside the tree are left
+ * without an entity.
+ */
+static int quad_key_slice(void *data)
+{
+    QuadWorker *worker = (QuadWorker *)data;
+    QuadBuild *build = worker->build;
+    SDL_Rect bounds = worker->tree->root->bounds;
+
+    size_t start = build->count * worker->index / build->workers;
+    size_t end = build->count * (worker->index + 1) / build->workers;
+    for (size_t i = start; i < end; i++)
+    {
+        Entity *entity = build->entities[i];
+        bool inside = is_point_inside(bounds, get_rect_centre(entity->position));
+        build->keys[i].key = inside ? quad_key(bounds, entity) : 0;
+        build->keys[i].entity = inside ? entity : NULL;
+    }
+    return 0;
+}
+
+/**
+ * Claim and build tasks until there are none left, the nodes come from the
+ * worker's own pool.
+ */
+static int quad_build_tasks(void *data)
+{
+    QuadWorker *worker = (QuadWorker *)data;
+    QuadBuild *build = worker->build;
+
+    for (;;)
+    {
+        size_t next = SDL_AtomicAdd(&build->next, 1);
+        if (next >= build->task_count)
+            return 0;
+
+        // The run sits in scratch, sort it using the same span of keys.
+        QuadTask *task = &build->tasks[next];
+        QuadKey *run = build->scratch + task->start;
+        QuadKey *spare = build->keys + task->start;
+        quad_sort_keys(run, spare, task->count);
+        quad_build_node(task->node, run, spare, task->count, task->depth, &worker->pool,
+                        &worker->counters);
+    }
+}
+
+/**
+ * Run a job on every worker, the calling thread doing the first share.
+ */
+static void quad_run_workers(QuadWorker *workers, int count, SDL_ThreadFunction job)
+{
+    for (int i = 1; i < count; i++)
+        workers[i].thread = SDL_CreateThread(job, "quadbuild", &workers[i]);
+
+    job(&workers[0]);
+
+    for (int i = 1; i < count; i++)
+    {
+        // Do the share of a thread that could not be started ourselves.
+        if (!workers[i].thread)
+            job(&workers[i]);
+        SDL_WaitThread(workers[i].thread, NULL);
+        workers[i].thread = NULL;
+    }
+}
+
+/**
+ * Split the nodes above the partitions until each subtree is small enough to
+ * hand to a worker as a task, offsets holds where each partition starts.
+ */
+static bool quad_plan_tasks(QuadBuild *build, QuadTreeNode *node, size_t *offsets, size_t grain)
+{
+    QuadPlanned stack[QUAD_WALK_STACK];
+    int top = 0;
+    stack[0] = (QuadPlanned){.node = node, .first = 0, .span = QUAD_PARTITIONS, .depth = 0};
+    while (top >= 0)
+    {
+        QuadPlanned planned = stack[top--];
+        size_t start = offsets[planned.first];
+        size_t count = offsets[planned.first + planned.span] - start;
+
+        // Skewed parts of the tree are split further than sparse ones.
+        if (planned.span == 1 || count <= grain || count <= node->tree->capacity ||
+            !quad_can_subdivide(planned.node))
+        {
+            build->tasks[build->task_count++] = (QuadTask){
+                .node = planned.node, .start = start, .count = count, .depth = planned.depth};
+            continue;
+        }
+
+        if (!quad_subdivide(planned.node, &node->tree->pool, &node->tree->counters))
+            return false;
+
+        // Pushed backwards so the tasks are planned in quadrent order.
+        size_t span = planned.span / QUADRENTS;
+        for (int q = QUADRENTS - 1; q >= 0; q--)
+        {
+            stack[++top] = (QuadPlanned){.node = planned.node->children[q],
+                                         .first = planned.first + q * span,
+                                         .span = span,
+                                         .depth = planned.depth + 1};
+        }
+    }
+    return true;
+}
+
+/**
+ * Add the counters of a build worker to those of the tree.
+ */
+static void quad_add_counters(QuadCounters *counters, QuadCounters *other)
+{
+    counters->branches += other->branches;
+    for (int depth = 0; depth <= QUAD_WALK_DEPTH; depth++)
+        counters->depths[depth] += other->depths[depth];
+    counters->spilled += other->spilled;
+    counters->spilled_bytes += other->spilled_bytes;
+    counters->splits += other->splits;
+    counters->merges += other->merges;
+    counters->scattered += other->scattered;
+}
+
+/**
+ * Order tasks largest first, so the longest builds start earliest.
+ */
+static int quad_compare_tasks(const void *a, const void *b)
+{
+    size_t first = ((const QuadTask *)a)->count;
+    size_t second = ((const QuadTask *)b)->count;
+    return first < second ? 1 : first > second ? -1 : 0;
+}
+
+// ---------------- Main functions ----------------
+
+/**
+ * Initialize the quad tree node.
+ */
+void quad_init_tree(QuadTree *quad, SDL_Rect bounds, uint16_t capacity)
+{
+    // Just the root.
+    memset(&quad->counters, 0, sizeof(QuadCounters));
+    quad->counters.depths[0] = 1;
+
+    // Every leaf needs space for at least one entity.
+    quad->capacity = capacity > 0 ? capacity : 1;
+    // Merge at half capacity so a leaf does not split again straight away.
+    quad->merge_threshold = quad->capacity / 2;
+
+    // Every other node comes from the pool.
+    quad_init_pool(&quad->pool, quad->capacity);
+
+    // Initialize the root node, its bucket follows it.
+    quad->root = (QuadTreeNode *)malloc(sizeof(QuadTreeNode) +
+                                        sizeof(Entity *) * quad->capacity);
+    quad->root->entities = quad->root->bucket = (Entity **)(quad->root + 1);
+    quad->looseness = 1.0f;
+    // Split as far as the walks can reach by default.
+    quad->max_depth = QUAD_WALK_DEPTH;
+    quad->min_size = 1;
+    quad->reach = 0;
+    quad_init_node(quad->root, quad, NULL, bounds);
+
+    // Nothing queued, and removals merge straight away.
+    memset(&quad->batch, 0, sizeof(QuadBatch));
+    quad->lazy = false;
+}
+
+/**
+ * How far an entity can hang out of the loose bounds of the node holding it,
+ * queries grow their bounds checks by this much. Always 0 in loose mode.
+ */
+int quad_margin(const QuadTree *quad)
+{
+    // Placed by centre, entities can hang out of their node by up to half their size.
+    return quad->looseness > 1.0f ? 0 : quad->reach;
+}
+
+/**
+ * Switch an empty tree to loose mode, where the bounds of every node are
+ * scaled by looseness (above 1.0f) and each entity is stored in the deepest
+ * node whose loose bounds hold its whole position. Returns false if the tree
+ * is not empty.
+ */
+bool quad_set_loose(QuadTree *quad, float looseness)
+{
+    if (quad->root->total > 0)
+    {
+        ERROR_LOG("Looseness can only be changed on an empty tree!\n");
+        return false;
+    }
+
+    // Drop any empty branches left behind so every node is rebuilt loose.
+    quad_release_children(quad->root);
+    quad->looseness = looseness;
+    quad->root->loose = quad_loosen(quad->root->bounds, looseness);
+    return true;
+}
+
+/**
+ * Limit how far an empty tree splits, nodes are never deeper than max_depth
+ * or narrower than min_size. A node that can not be split keeps anything past
+ * its capacity in a spilled bucket on the heap. Returns false if the tree is
+ * not empty.
+ */
+bool quad_set_limits(QuadTree *quad, uint8_t max_depth, uint16_t min_size)
+{
+    if (quad->root->total > 0)
+    {
+        ERROR_LOG("Limits can only be changed on an empty tree!\n");
+        return false;
+    }
+
+    quad_release_children(quad->root);
+    quad->max_depth = max_depth < QUAD_WALK_DEPTH ? max_depth : QUAD_WALK_DEPTH;
+    quad->min_size = min_size > 0 ? min_size : 1;
+    return true;
+}
+
+/**
+ * Switch removals between merging straight away and only taking the entity
+ * out of its bucket, leaving the merging for quad_compact. Anything left to
+ * compact is finished off when lazy removal is turned off.
+ */
+void quad_set_lazy(QuadTree *quad, bool lazy)
+{
+    if (quad->lazy && !lazy)
+        quad_compact(quad, 0);
+    quad->lazy = lazy;
+}
+
+/**
+ * Merge the branches lazy removals have left under the threshold and give
+ * back spilled buckets that fit again, for up to budget microseconds (0 for
+ * no limit). Work left over is picked up by the next call, returns true once
+ * there is none.
+ */
+bool quad_compact(QuadTree *quad, uint32_t budget)
+{
+    QuadCompaction compaction = {.deadline = 0, .visited = 0};
+    if (budget > 0)
+        compaction.deadline = SDL_GetPerformanceCounter() +
+                              SDL_GetPerformanceFrequency() * budget / 1000000;
+
+    quad_walk(quad->root, quad_compact_node, quad_compact_done, &compaction);
+    return !quad->root->dirty;
+}
+
+/**
+ * Free quad tree.
+ */
+void quad_free_tree(QuadTree *quad)
+{
+    // Spilled buckets live outside the pool, only walk the tree if there are any.
+    if (quad->counters.spilled > 0)
+        quad_release_children(quad->root);
+    quad_empty(quad->root);
+
+    // Dropping the slabs frees every node below the root at once.
+    quad_free_pool(&quad->pool);
+    free(quad->root);
+    quad->root = NULL;
+
+    free(quad->batch.inserts);
+    free(quad->batch.removes);
+    memset(&quad->batch, 0, sizeof(QuadBatch));
+}
+
+/**
+ * Returns the pointer to the largest node that falls within the provided
+ * rectangle.
+ */
+QuadTreeNode *quad_find_node(QuadTreeNode *node, SDL_Rect view)
+{
+    QuadViewSearch search = {.view = view, .found = NULL};
+    quad_walk(node, quad_search_view, NULL, &search);
+    return search.found;
+}
+
+/**
+ * Returns the pointer to the stored entity under the centre of point on
+ * success, and NULL if no entity was found.
+ */
+Entity *quad_find_entity(QuadTreeNode *node, SDL_Rect point)
+{
+    // Does this node exist?
+    if (!node)
+        return NULL;
+
+    SDL_Point p = get_rect_centre(point);
+    QuadTreeNode *holder;
+    uint16_t index;
+    if (!quad_find_at(node, p, &holder, &index))
+        return NULL;
+
+    return holder->entities[index];
+}
+
+/**
+ * Insert an entity into the quad tree. Passed the root, the tree grows to
+ * meet an entity whose centre is outside it.
+ */
+bool quad_insert_entity(QuadTreeNode *node, Entity *entity)
+{
+    if (!node)
+    {
+        ERROR_LOG("Called on a null node!\n");
+        return false;
+    }
+
+    // Only the root grows to meet an entity outside it.
+    SDL_Point point = get_rect_centre(entity->position);
+    if (!is_point_inside(node->bounds, point) && (node->parent || !quad_grow(node->tree, point)))
+        return false;
+
+    return quad_place(node, entity, point, NULL);
+}
+
+/**
+ * Remove an entity from the quad tree, a lazy tree leaves any merging to
+ * quad_compact.
+ */
+bool quad_remove_entity(QuadTreeNode *node, SDL_Rect point)
+{
+    if (!node)
+        return false;
+
+    SDL_Point p = get_rect_centre(point);
+    QuadTreeNode *holder;
+    uint16_t index;
+    if (!quad_find_at(node, p, &holder, &index))
+        return false;
+
+    // Mark the entity for cleanup.
+    holder->entities[index]->remove = true;
+    quad_detach(holder, index, NULL);
+    return true;
+}
+
+/**
+ * Move an entity whose position has changed from old_position. The search
+ * starts from node, ideally the leaf holding the entity, and only climbs as
+ * far as the new position needs.
+ */
+bool quad_update_entity(QuadTreeNode *node, Entity *entity, SDL_Rect old_position)
+{
+    if (!node)
+        return false;
+
+    SDL_Point from = get_rect_centre(old_position);
+    SDL_Point to = get_rect_centre(entity->position);
+
+    // Climb from the hint until we are above the old position.
+    while (node->parent && !quad_holds_point(node, from))
+        node = node->parent;
+
+    QuadTreeNode *holder;
+    uint16_t index;
+    if (!quad_find_holder(node, entity, from, &holder, &index))
+        return false;
+
+    // It may have grown where it is.
+    quad_widen_reach(holder->tree, entity->position);
+
+    // Still the deepest node it fits in, nothing to restructure.
+    if (quad_fits(holder, entity, to) &&
+        (quad_is_leaf(holder) ||
+         !quad_fits(holder->children[get_dir(get_rect_centre(holder->bounds), to)], entity, to)))
+        return true;
+
+    // The lowest ancestor that holds both positions is left untouched.
+    QuadTreeNode *common = holder;
+    while (common && !quad_fits(common, entity, to))
+        common = common->parent;
+
+    QuadTree *quad = holder->tree;
+    quad_detach(holder, index, common);
+
+    // Has it left the tree entirely? Grow the root out to meet it.
+    if (!common)
+        return quad_grow(quad, to) && quad_place(quad->root, entity, to, NULL);
+
+    if (quad_place(common, entity, to, common))
+        return true;
+
+    // There was no room for it, it has left the rest of the tree too.
+    for (QuadTreeNode *n = common; n; n = n->parent)
+        n->total--;
+    return false;
+}
+
+/**
+ * Replace the contents of the tree with the provided entities, sorting them by
+ * their path through the tree and building every node once.
+ */
+bool quad_build_from_entities(QuadTree *quad, Entity **entities, size_t count)
+{
+    // Start from an empty root, grown over everything.
+    quad_release_children(quad->root);
+    quad_empty(quad->root);
+    quad->reach = 0;
+    quad_grow_over(quad, entities, count);
+
+    // Loose placement depends on extents, not just the path of the centre.
+    if (quad->looseness > 1.0f)
+    {
+        bool placed = true;
+        for (size_t i = 0; i < count; i++)
+            placed = quad_insert_entity(quad->root, entities[i]) && placed;
+        return placed;
+    }
+
+    QuadKey *keys = (QuadKey *)malloc(sizeof(QuadKey) * count);
+    QuadKey *scratch = (QuadKey *)malloc(sizeof(QuadKey) * count);
+    if (count > 0 && (!keys || !scratch))
+    {
+        ERROR_LOG("Unable to allocate keys for %zu entities!\n", count);
+        free(keys);
+        free(scratch);
+        return false;
+    }
+
+    // Key everything that lands inside the tree.
+    size_t inside = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!is_point_inside(quad->root->bounds, get_rect_centre(entities[i]->position)))
+            continue;
+        keys[inside].key = quad_key(quad->root->bounds, entities[i]);
+        keys[inside].entity = entities[i];
+        inside++;
+    }
+
+    quad_sort_keys(keys, scratch, inside);
+    uint32_t placed =
+        quad_build_node(quad->root, keys, scratch, inside, 0, &quad->pool, &quad->counters);
+
+    free(keys);
+    free(scratch);
+    return placed == count;
+}
+
+/**
+ * Replace the contents of the tree with the provided entities like
+ * quad_build_from_entities, splitting the work over workers threads (or one
+ * per CPU if workers is 0). Returns false if any entity could not be placed.
+ */
+bool quad_build_parallel(QuadTree *quad, Entity **entities, size_t count, int workers)
+{
+    if (workers <= 0)
+        workers = SDL_GetCPUCount();
+    if (workers > QUAD_MAX_WORKERS)
+        workers = QUAD_MAX_WORKERS;
+
+    // Not worth the threads, or loose placement that needs extents.
+    if (workers <= 1 || count / workers < QUAD_PARALLEL_MINIMUM || quad->looseness > 1.0f)
+        return quad_build_from_entities(quad, entities, count);
+
+    // Start from an empty root, grown over everything.
+    quad_release_children(quad->root);
+    quad_empty(quad->root);
+    quad->reach = 0;
+    quad_grow_over(quad, entities, count);
+
+    QuadBuild *build = (QuadBuild *)malloc(sizeof(QuadBuild));
+    QuadWorker *team = (QuadWorker *)malloc(sizeof(QuadWorker) * workers);
+    QuadKey *keys = (QuadKey *)malloc(sizeof(QuadKey) * count);
+    QuadKey *scratch = (QuadKey *)malloc(sizeof(QuadKey) * count);
+    if (!build || !team || !keys || !scratch)
+    {
+        ERROR_LOG("Unable to allocate a parallel build of %zu entities!\n", count);
+        free(build);
+        free(team);
+        free(keys);
+        free(scratch);
+        return false;
+    }
+
+    build->entities = entities;
+    build->count = count;
+    build->keys = keys;
+    build->scratch = scratch;
+    build->task_count = 0;
+    build->workers = workers;
+    SDL_AtomicSet(&build->next, 0);
+    for (int i = 0; i < workers; i++)
+    {
+        team[i] = (QuadWorker){.build = build, .tree = quad, .index = i, .thread = NULL};
+        quad_init_pool(&team[i].pool, quad->capacity);
+        memset(&team[i].counters, 0, sizeof(QuadCounters));
+    }
+
+    // Every worker keys its share of the entities.
+    quad_run_workers(team, workers, quad_key_slice);
+
+    // Partition by the top levels of the key, a counting sort on those digits.
+    int shift = 2 * (QUAD_KEY_DEPTH - QUAD_PARTITION_DEPTH);
+    size_t offsets[QUAD_PARTITIONS + 1] = {0};
+    for (size_t i = 0; i < count; i++)
+    {
+        if (keys[i].entity)
+            offsets[(keys[i].key >> shift) + 1]++;
+    }
+    for (int p = 0; p < QUAD_PARTITIONS; p++)
+        offsets[p + 1] += offsets[p];
+
+    size_t cursor[QUAD_PARTITIONS];
+    memcpy(cursor, offsets, sizeof(cursor));
+    for (size_t i = 0; i < count; i++)
+    {
+        if (keys[i].entity)
+            scratch[cursor[keys[i].key >> shift]++] = keys[i];
+    }
+
+    // Split the top of the tree into tasks, a few for each worker.
+    size_t grain = offsets[QUAD_PARTITIONS] / (workers * 4) + 1;
+    bool placed = quad_plan_tasks(build, quad->root, offsets, grain);
+    if (placed)
+    {
+        qsort(build->tasks, build->task_count, sizeof(QuadTask), quad_compare_tasks);
+        quad_run_workers(team, workers, quad_build_tasks);
+
+        // Account for every subtree in the nodes above it.
+        for (size_t t = 0; t < build->task_count; t++)
+        {
+            QuadTreeNode *node = build->tasks[t].node;
+            for (QuadTreeNode *n = node->parent; n; n = n->parent)
+                n->total += node->total;
+        }
+    }
+
+    // Stitch the nodes each worker allocated into the tree's pool, and count them.
+    for (int i = 0; i < workers; i++)
+    {
+        quad_add_counters(&quad->counters, &team[i].counters);
+        if (!quad_pool_adopt(&quad->pool, &team[i].pool))
+        {
+            ERROR_LOG("Unable to adopt the nodes of build worker %d!\n", i);
+            placed = false;
+        }
+    }
+
+    placed = placed && quad->root->total == count;
+    free(build);
+    free(team);
+    free(keys);
+    free(scratch);
+    return placed;
+}
+
+/**
+ * Start queueing inserts and removals, the tree is left as it is until
+ * quad_batch_commit.
+ */
+void quad_batch_begin(QuadTree *quad)
+{
+    quad->batch.open = true;
+}
+
+/**
+ * Queue an entity to be inserted on commit, it is inserted straight away if
+ * no batch is open.
+ */
+bool quad_batch_insert(QuadTree *quad, Entity *entity)
+{
+    if (!quad->batch.open)
+        return quad_insert_entity(quad->root, entity);
+
+    return quad_batch_push(&quad->batch.inserts, &quad->batch.insert_count,
+                           &quad->batch.insert_maximum, entity);
+}
+
+/**
+ * Queue an entity to be removed on commit, it is removed straight away if no
+ * batch is open. The entity must not move until then.
+ */
+bool quad_batch_remove(QuadTree *quad, Entity *entity)
+{
+    QuadBatch *batch = &quad->batch;
+    if (!batch->open)
+    {
+        QuadTreeNode *holder;
+        uint16_t index;
+        if (!quad_find_holder(quad->root, entity, get_rect_centre(entity->position), &holder,
+                              &index))
+            return false;
+        quad_detach(holder, index, NULL);
+        return true;
+    }
+
+    // Never made it into the tree, just forget the insert.
+    for (uint32_t i = 0; i < batch->insert_count; i++)
+    {
+        if (batch->inserts[i] == entity)
+        {
+            batch->inserts[i] = batch->inserts[--batch->insert_count];
+            return true;
+        }
+    }
+
+    return quad_batch_push(&batch->removes, &batch->remove_count, &batch->remove_maximum,
+                           entity);
+}
+
+/**
+ * Move an entity whose position has changed from old_position. One still
+ * queued for insertion is left to be placed where it is on commit, anything
+ * else is moved straight away.
+ */
+bool quad_batch_update(QuadTree *quad, Entity *entity, SDL_Rect old_position)
+{
+    QuadBatch *batch = &quad->batch;
+    if (batch->open)
+    {
+        // Not in the tree yet, the commit inserts it wherever it is by then.
+        for (uint32_t i = 0; i < batch->insert_count; i++)
+        {
+            if (batch->inserts[i] == entity)
+                return true;
+        }
+    }
+
+    return quad_update_entity(quad->root, entity, old_position);
+}
+
+/**
+ * Apply every queued operation, splitting and merging each node at most once,
+ * and close the batch. A lazy tree leaves the merging to quad_compact.
+ * Returns false if any operation could not be applied.
+ */
+bool quad_batch_commit(QuadTree *quad)
+{
+    QuadBatch *batch = &quad->batch;
+    bool applied = true;
+
+    // Take out the removed entities, merging waits until the inserts are in.
+    for (uint32_t i = 0; i < batch->remove_count; i++)
+    {
+        Entity *entity = batch->removes[i];
+        QuadTreeNode *holder;
+        uint16_t index;
+        if (!quad_find_holder(quad->root, entity, get_rect_centre(entity->position), &holder,
+                              &index))
+        {
+            applied = false;
+            continue;
+        }
+        quad_take(holder, index);
+        for (QuadTreeNode *n = holder; n; n = n->parent)
+        {
+            n->total--;
+            n->dirty = true;
+        }
+    }
+
+    if (quad->looseness > 1.0f)
+    {
+        // Loose placement depends on extents, not just the path of the centre.
+        for (uint32_t i = 0; i < batch->insert_count; i++)
+            applied = quad_insert_entity(quad->root, batch->inserts[i]) && applied;
+    }
+    else if (batch->insert_count > 0)
+    {
+        // Keys depend on the bounds of the root, so it grows first.
+        quad_grow_over(quad, batch->inserts, batch->insert_count);
+
+        // Sort the inserts so each subtree takes its whole run at once.
+        size_t room = batch->insert_count + quad->capacity;
+        QuadKey *keys = (QuadKey *)malloc(sizeof(QuadKey) * batch->insert_count);
+        QuadKey *scratch = (QuadKey *)malloc(sizeof(QuadKey) * room);
+        QuadKey *combined = (QuadKey *)malloc(sizeof(QuadKey) * room);
+        if (!keys || !scratch || !combined)
+        {
+            ERROR_LOG("Unable to allocate keys for %u entities!\n", batch->insert_count);
+            applied = false;
+        }
+        else
+        {
+            size_t inside = 0;
+            for (uint32_t i = 0; i < batch->insert_count; i++)
+            {
+                Entity *entity = batch->inserts[i];
+                if (!is_point_inside(quad->root->bounds, get_rect_centre(entity->position)))
+                    continue;
+                keys[inside].key = quad_key(quad->root->bounds, entity);
+                keys[inside].entity = entity;
+                inside++;
+            }
+
+            quad_sort_keys(keys, scratch, inside);
+            uint32_t placed = quad_merge_keys(quad->root, keys, scratch, combined, inside, 0);
+            applied = applied && placed == batch->insert_count;
+        }
+        free(keys);
+        free(scratch);
+        free(combined);
+    }
+
+    // Merge whatever the removals left too small, a lazy tree leaves it to quad_compact.
+    if (!quad->lazy)
+        quad_walk(quad->root, quad_collapse_node, NULL, NULL);
+
+    batch->insert_count = 0;
+    batch->remove_count = 0;
+    batch->open = false;
+    return applied;
+}
+
+/**
+ * Fill stats with the shape of the tree and the memory it holds, read from
+ * counters kept as it changes rather than a walk.
+ */
+void quad_stats(QuadTree *quad, QuadStats *stats)
+{
+    QuadCounters *counters = &quad->counters;
+
+    // Every branch adds four nodes under the root, and stops being a leaf.
+    stats->branches = counters->branches;
+    stats->nodes = 1 + QUADRENTS * counters->branches;
+    stats->leaves = stats->nodes - stats->branches;
+    stats->entities = quad->root->total;
+    stats->entities_per_leaf = (float)stats->entities / stats->leaves;
+
+    memcpy(stats->depths, counters->depths, sizeof(stats->depths));
+    stats->depth = 0;
+    for (int depth = 0; depth <= QUAD_WALK_DEPTH; depth++)
+    {
+        if (counters->depths[depth])
+            stats->depth = depth;
+    }
+
+    stats->spilled = counters->spilled;
+    stats->bytes = sizeof(QuadTreeNode) + sizeof(Entity *) * quad->capacity +
+                   quad->pool.bytes + sizeof(void *) * quad->pool.slab_maximum +
+                   counters->spilled_bytes +
+                   sizeof(Entity *) * (quad->batch.insert_maximum + quad->batch.remove_maximum);
+    stats->splits = counters->splits;
+    stats->merges = counters->merges;
+    stats->fragmentation = quad_fragmentation(quad);
+}
+
+/**
+ * Start counting splits and merges again from zero.
+ */
+void quad_reset_stats(QuadTree *quad)
+{
+    quad->counters.splits = 0;
+    quad->counters.merges = 0;
+}
+
+/**
+ * How far the nodes have drifted from depth first order, 0 after a relayout
+ * rising towards 1 as blocks of children are allocated and released.
+ */
+float quad_fragmentation(QuadTree *quad)
+{
+    uint32_t scattered = quad->counters.scattered;
+    if (scattered == 0)
+        return 0.0f;
+    return (float)scattered / (quad->counters.branches + scattered);
+}
+
+/**
+ * Copy every node below the root into one buffer in the depth first order
+ * the tree is walked in, so a walk reads memory almost sequentially. Any
+ * pointer to a node other than the root is left dangling. Returns false,
+ * leaving the tree as it was, if the buffer could not be allocated.
+ */
+bool quad_relayout(QuadTree *quad)
+{
+    QuadNodePool pool;
+    quad_init_pool(&pool, quad->capacity);
+    pool.blocks_per_slab = quad->pool.blocks_per_slab;
+    if (!quad_pool_reserve(&pool, quad->counters.branches))
+        return false;
 
+    // Each branch takes the next block as it is entered, the old ones stay
+    // readable until the copy is done.
+    quad_walk(quad->root, quad_relayout_block, NULL, &pool);
+    quad_free_pool(&quad->pool);
+    quad->pool = pool;
+    quad->counters.scattered = 0;
     return true;
 }
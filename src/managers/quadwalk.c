@@ -0,0 +1,79 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../../include/managers/quadwalk.h"
+#include "../../include/managers/quadtree.h"
+
+#include "../../include/debug.h"
+
+// Hint that a node is about to be read.
+#if defined(__GNUC__)
+#define QUAD_PREFETCH(node) __builtin_prefetch(node)
+#else
+#define QUAD_PREFETCH(node)
+#endif
+
+/**
+ * A node on the walk and the next of its children to visit.
+ */
+typedef struct QuadFrame
+{
+    QuadTreeNode *node;
+    uint8_t next;
+} QuadFrame;
+
+// ---------------- Main functions ----------------
+
+/**
+ * Walk the subtree under node depth first in quadrent order. Enter is called
+ * on the way down before any children, leave on the way back up after all
+ * of them, either may be NULL. Leave may release the children of the node it
+ * is given. Returns false if a visitor stopped the walk.
+ */
+bool quad_walk(QuadTreeNode *node, QuadNodeVisitor enter, QuadNodeVisitor leave, void *data)
+{
+    if (!node)
+        return true;
+
+    QuadFrame stack[QUAD_WALK_DEPTH + 1];
+    int top = 0;
+
+    QuadWalkAction action = enter ? enter(node, data) : QUAD_WALK_CONTINUE;
+    if (action == QUAD_WALK_STOP)
+        return false;
+    stack[0].node = node;
+    stack[0].next = action == QUAD_WALK_SKIP ? QUADRENTS : 0;
+
+    while (top >= 0)
+    {
+        QuadFrame *frame = &stack[top];
+        QuadTreeNode *child = frame->next < QUADRENTS ? frame->node->children[frame->next] : NULL;
+
+        // Done with this node's children, leave it.
+        if (!child)
+        {
+            if (leave && leave(frame->node, data) == QUAD_WALK_STOP)
+                return false;
+            top--;
+            continue;
+        }
+        frame->next++;
+
+        // Its children are read next, fetch their block early.
+        if (child->children[TOPLEFT])
+            QUAD_PREFETCH(child->children[TOPLEFT]);
+
+        action = enter ? enter(child, data) : QUAD_WALK_CONTINUE;
+        if (action == QUAD_WALK_STOP)
+            return false;
+
+        if (top == QUAD_WALK_DEPTH)
+        {
+            ERROR_LOG("Quad tree deeper than %d levels!\n", QUAD_WALK_DEPTH);
+            return false;
+        }
+        stack[++top].node = child;
+        stack[top].next = action == QUAD_WALK_SKIP ? QUADRENTS : 0;
+    }
+    return true;
+}
@@ -0,0 +1,392 @@
+#include <SDL2/SDL.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../../include/debug.h"
+#include "../../include/managers/quadsearch.h"
+#include "../../include/managers/spatialgrid.h"
+#include "../../include/util/camera.h"
+
+// Slots a new grid starts with.
+#define GRID_SLOTS 1024
+// Average entities per slot before the slots are doubled.
+#define GRID_LOAD 4
+
+// ---------------- Helper functions ----------------
+
+/**
+ * The cell holding coordinate v, rounding down for negatives.
+ */
+static inline int32_t grid_cell(int v, int size)
+{
+    return v >= 0 ? v / size : -(int32_t)(((int64_t)size - 1 - v) / size);
+}
+
+/**
+ * The slot a cell is hashed to.
+ */
+static inline GridSlot *grid_slot(SpatialGrid *grid, int32_t cx, int32_t cy)
+{
+    uint32_t hash = ((uint32_t)cx * 73856093u) ^ ((uint32_t)cy * 19349663u);
+    return &grid->slots[hash & (grid->slot_count - 1)];
+}
+
+/**
+ * Append an entry to its slot.
+ */
+static bool grid_push(SpatialGrid *grid, GridEntry entry)
+{
+    GridSlot *slot = grid_slot(grid, entry.cx, entry.cy);
+    if (slot->count == slot->maximum)
+    {
+        uint32_t maximum = slot->maximum ? slot->maximum * 2 : 4;
+        GridEntry *entries = (GridEntry *)realloc(slot->entries, sizeof(GridEntry) * maximum);
+        if (!entries)
+        {
+            ERROR_LOG("Unable to grow a grid slot to %u entities!\n", maximum);
+            return false;
+        }
+        slot->entries = entries;
+        slot->maximum = maximum;
+    }
+    slot->entries[slot->count++] = entry;
+    return true;
+}
+
+/**
+ * Double the slots and hash every entry again, keeping the old slots if
+ * memory runs out.
+ */
+static void grid_rehash(SpatialGrid *grid)
+{
+    uint32_t old_count = grid->slot_count;
+    GridSlot *old = grid->slots;
+    GridSlot *slots = (GridSlot *)calloc(old_count * 2, sizeof(GridSlot));
+    if (!slots)
+        return;
+
+    grid->slots = slots;
+    grid->slot_count = old_count * 2;
+    for (uint32_t s = 0; s < old_count; s++)
+    {
+        for (uint32_t i = 0; i < old[s].count; i++)
+        {
+            if (!grid_push(grid, old[s].entries[i]))
+            {
+                // Put everything back as it was.
+                for (uint32_t t = 0; t < grid->slot_count; t++)
+                    free(slots[t].entries);
+                free(slots);
+                grid->slots = old;
+                grid->slot_count = old_count;
+                return;
+            }
+        }
+    }
+
+    for (uint32_t s = 0; s < old_count; s++)
+        free(old[s].entries);
+    free(old);
+}
+
+/**
+ * Take the entry of an entity out of the cell under centre.
+ */
+static bool grid_take(SpatialGrid *grid, Entity *entity, SDL_Point centre)
+{
+    int32_t cx = grid_cell(centre.x, grid->cell_size);
+    int32_t cy = grid_cell(centre.y, grid->cell_size);
+    GridSlot *slot = grid_slot(grid, cx, cy);
+    for (uint32_t i = 0; i < slot->count; i++)
+    {
+        if (slot->entries[i].entity == entity)
+        {
+            slot->entries[i] = slot->entries[--slot->count];
+            grid->count--;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Offer every entity stored in a cell to the k nearest.
+ */
+static void grid_nearest_cell(SpatialGrid *grid, QuadNearest *nearest, SDL_Point point,
+                              int32_t cx, int32_t cy)
+{
+    GridSlot *slot = grid_slot(grid, cx, cy);
+    for (uint32_t i = 0; i < slot->count; i++)
+    {
+        Entity *entity = slot->entries[i].entity;
+        if (slot->entries[i].cx == cx && slot->entries[i].cy == cy)
+            quad_nearest_offer(nearest, entity, quad_distance_to_centre(entity->position, point));
+    }
+}
+
+// ---------------- Main functions ----------------
+
+/**
+ * Initialize an empty grid of cells cell_size across.
+ */
+bool grid_init(SpatialGrid *grid, int cell_size)
+{
+    memset(grid, 0, sizeof(SpatialGrid));
+    grid->cell_size = cell_size > 0 ? cell_size : 1;
+    grid->slots = (GridSlot *)calloc(GRID_SLOTS, sizeof(GridSlot));
+    if (!grid->slots)
+    {
+        ERROR_LOG("Unable to allocate grid slots!\n");
+        return false;
+    }
+    grid->slot_count = GRID_SLOTS;
+    grid_clear(grid);
+    return true;
+}
+
+/**
+ * Free the grid.
+ */
+void grid_free(SpatialGrid *grid)
+{
+    for (uint32_t s = 0; s < grid->slot_count; s++)
+        free(grid->slots[s].entries);
+    free(grid->slots);
+    memset(grid, 0, sizeof(SpatialGrid));
+}
+
+/**
+ * Take every entity out of the grid.
+ */
+void grid_clear(SpatialGrid *grid)
+{
+    for (uint32_t s = 0; s < grid->slot_count; s++)
+        grid->slots[s].count = 0;
+    grid->count = 0;
+    grid->reach_w = 0;
+    grid->reach_h = 0;
+    grid->min_cx = grid->min_cy = INT32_MAX;
+    grid->max_cx = grid->max_cy = INT32_MIN;
+}
+
+/**
+ * Insert an entity into the grid.
+ */
+bool grid_insert(SpatialGrid *grid, Entity *entity)
+{
+    if (grid->count >= grid->slot_count * GRID_LOAD)
+        grid_rehash(grid);
+
+    SDL_Point centre = get_rect_centre(entity->position);
+    GridEntry entry = {.entity = entity,
+                       .cx = grid_cell(centre.x, grid->cell_size),
+                       .cy = grid_cell(centre.y, grid->cell_size)};
+    if (!grid_push(grid, entry))
+        return false;
+    grid->count++;
+
+    // Widen the area queries have to look over.
+    if (entity->position.w > grid->reach_w)
+        grid->reach_w = entity->position.w;
+    if (entity->position.h > grid->reach_h)
+        grid->reach_h = entity->position.h;
+    if (entry.cx < grid->min_cx)
+        grid->min_cx = entry.cx;
+    if (entry.cy < grid->min_cy)
+        grid->min_cy = entry.cy;
+    if (entry.cx > grid->max_cx)
+        grid->max_cx = entry.cx;
+    if (entry.cy > grid->max_cy)
+        grid->max_cy = entry.cy;
+    return true;
+}
+
+/**
+ * Remove an entity from the grid, it must not have moved since it was
+ * inserted or last updated.
+ */
+bool grid_remove(SpatialGrid *grid, Entity *entity)
+{
+    return grid_take(grid, entity, get_rect_centre(entity->position));
+}
+
+/**
+ * Move an entity whose position has changed from old_position.
+ */
+bool grid_update(SpatialGrid *grid, Entity *entity, SDL_Rect old_position)
+{
+    SDL_Point from = get_rect_centre(old_position);
+    SDL_Point to = get_rect_centre(entity->position);
+
+    // Still in the same cell, only the reach can have changed.
+    if (grid_cell(from.x, grid->cell_size) == grid_cell(to.x, grid->cell_size) &&
+        grid_cell(from.y, grid->cell_size) == grid_cell(to.y, grid->cell_size) &&
+        entity->position.w <= grid->reach_w && entity->position.h <= grid->reach_h)
+        return true;
+
+    if (!grid_take(grid, entity, from))
+        return false;
+    return grid_insert(grid, entity);
+}
+
+/**
+ * Visit every entity overlapping rect, returns the number visited.
+ */
+size_t grid_visit_rect(SpatialGrid *grid, SDL_Rect rect, QuadVisitor visit, void *data)
+{
+    if (grid->count == 0)
+        return 0;
+
+    // Entities whose centres lie this far outside rect can still overlap it.
+    int32_t cx0 = grid_cell(rect.x - grid->reach_w, grid->cell_size);
+    int32_t cy0 = grid_cell(rect.y - grid->reach_h, grid->cell_size);
+    int32_t cx1 = grid_cell(rect.x + rect.w + grid->reach_w, grid->cell_size);
+    int32_t cy1 = grid_cell(rect.y + rect.h + grid->reach_h, grid->cell_size);
+    cx0 = cx0 > grid->min_cx ? cx0 : grid->min_cx;
+    cy0 = cy0 > grid->min_cy ? cy0 : grid->min_cy;
+    cx1 = cx1 < grid->max_cx ? cx1 : grid->max_cx;
+    cy1 = cy1 < grid->max_cy ? cy1 : grid->max_cy;
+    if (cx0 > cx1 || cy0 > cy1)
+        return 0;
+
+    size_t count = 0;
+    uint64_t cells = (uint64_t)(cx1 - cx0 + 1) * (uint64_t)(cy1 - cy0 + 1);
+    if (cells > grid->slot_count)
+    {
+        // Cheaper to look at every slot once than at every cell.
+        for (uint32_t s = 0; s < grid->slot_count; s++)
+        {
+            GridSlot *slot = &grid->slots[s];
+            for (uint32_t i = 0; i < slot->count; i++)
+            {
+                Entity *entity = slot->entries[i].entity;
+                if (!is_overlap(rect, entity->position))
+                    continue;
+                count++;
+                if (!visit(entity, data))
+                    return count;
+            }
+        }
+        return count;
+    }
+
+    for (int32_t cy = cy0; cy <= cy1; cy++)
+    {
+        for (int32_t cx = cx0; cx <= cx1; cx++)
+        {
+            // Cells sharing the slot are left to their own turn.
+            GridSlot *slot = grid_slot(grid, cx, cy);
+            for (uint32_t i = 0; i < slot->count; i++)
+            {
+                GridEntry *entry = &slot->entries[i];
+                if (entry->cx != cx || entry->cy != cy || !is_overlap(rect, entry->entity->position))
+                    continue;
+                count++;
+                if (!visit(entry->entity, data))
+                    return count;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * Returns an entity under the centre of point, or NULL if there is none.
+ */
+Entity *grid_find_entity(SpatialGrid *grid, SDL_Rect point)
+{
+    if (grid->count == 0)
+        return NULL;
+
+    SDL_Point p = get_rect_centre(point);
+    int32_t cx0 = grid_cell(p.x - grid->reach_w, grid->cell_size);
+    int32_t cy0 = grid_cell(p.y - grid->reach_h, grid->cell_size);
+    int32_t cx1 = grid_cell(p.x + grid->reach_w, grid->cell_size);
+    int32_t cy1 = grid_cell(p.y + grid->reach_h, grid->cell_size);
+    cx0 = cx0 > grid->min_cx ? cx0 : grid->min_cx;
+    cy0 = cy0 > grid->min_cy ? cy0 : grid->min_cy;
+    cx1 = cx1 < grid->max_cx ? cx1 : grid->max_cx;
+    cy1 = cy1 < grid->max_cy ? cy1 : grid->max_cy;
+    for (int32_t cy = cy0; cy <= cy1; cy++)
+    {
+        for (int32_t cx = cx0; cx <= cx1; cx++)
+        {
+            GridSlot *slot = grid_slot(grid, cx, cy);
+            for (uint32_t i = 0; i < slot->count; i++)
+            {
+                GridEntry *entry = &slot->entries[i];
+                if (entry->cx == cx && entry->cy == cy &&
+                    is_collision(p.x, p.y, entry->entity->position))
+                    return entry->entity;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Collect the k entities whose centres are closest to point, nearest first.
+ * Returns the number written to found.
+ */
+size_t grid_query_knn(SpatialGrid *grid, SDL_Point point, size_t k, Entity **found)
+{
+    if (k == 0 || grid->count == 0)
+        return 0;
+    if (k > grid->count)
+        k = grid->count;
+
+    QuadNearest nearest;
+    if (!quad_nearest_init(&nearest, k))
+        return 0;
+
+    // Search rings of cells outwards, ring r holds every centre closer than r cells.
+    int32_t pcx = grid_cell(point.x, grid->cell_size);
+    int32_t pcy = grid_cell(point.y, grid->cell_size);
+    uint64_t cells = 0;
+    for (int64_t r = 0;; r++)
+    {
+        for (int64_t dy = -r; dy <= r; dy++)
+        {
+            // Only the edge of the ring is new.
+            int64_t step = (dy == -r || dy == r) ? 1 : 2 * r;
+            for (int64_t dx = -r; dx <= r; dx += step)
+            {
+                int64_t cx = pcx + dx;
+                int64_t cy = pcy + dy;
+                if (cx >= grid->min_cx && cx <= grid->max_cx && cy >= grid->min_cy &&
+                    cy <= grid->max_cy)
+                    grid_nearest_cell(grid, &nearest, point, (int32_t)cx, (int32_t)cy);
+                cells++;
+            }
+        }
+
+        // Nothing outside the ring can beat what we have.
+        int64_t reached = r * grid->cell_size;
+        if (!quad_nearest_wants(&nearest, reached * reached))
+            break;
+        // Every stored centre has been looked at.
+        if (pcx - r <= grid->min_cx && pcx + r >= grid->max_cx && pcy - r <= grid->min_cy &&
+            pcy + r >= grid->max_cy)
+            break;
+        // Sparse grid, faster to look at everything.
+        if (cells > grid->slot_count)
+        {
+            nearest.count = 0;
+            for (uint32_t s = 0; s < grid->slot_count; s++)
+            {
+                for (uint32_t i = 0; i < grid->slots[s].count; i++)
+                {
+                    Entity *entity = grid->slots[s].entries[i].entity;
+                    quad_nearest_offer(&nearest, entity,
+                                       quad_distance_to_centre(entity->position, point));
+                }
+            }
+            break;
+        }
+    }
+
+    return quad_nearest_finish(&nearest, found);
+}
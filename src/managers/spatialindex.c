@@ -0,0 +1,475 @@
+#include <SDL2/SDL.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "../../include/config.h"
+#include "../../include/debug.h"
+#include "../../include/managers/aabbtree.h"
+#include "../../include/managers/linearquadtree.h"
+#include "../../include/managers/quadquery.h"
+#include "../../include/managers/quadtree.h"
+#include "../../include/managers/spatialgrid.h"
+#include "../../include/managers/spatialindex.h"
+
+// ---------------- Helper functions ----------------
+
+static bool spatial_quad_insert(void *index, Entity *entity)
+{
+    return quad_batch_insert((QuadTree *)index, entity);
+}
+
+static bool spatial_quad_remove(void *index, Entity *entity)
+{
+    return quad_batch_remove((QuadTree *)index, entity);
+}
+
+static bool spatial_quad_update(void *index, Entity *entity, SDL_Rect old_position)
+{
+    return quad_batch_update((QuadTree *)index, entity, old_position);
+}
+
+static size_t spatial_quad_query_rect(void *index, SDL_Rect rect, QuadVisitor visit, void *data)
+{
+    return quad_visit_rect(((QuadTree *)index)->root, rect, visit, data);
+}
+
+static Entity *spatial_quad_query_point(void *index, SDL_Rect point)
+{
+    return quad_find_entity(((QuadTree *)index)->root, point);
+}
+
+static size_t spatial_quad_knn(void *index, SDL_Point point, size_t k, Entity **found)
+{
+    return quad_query_knn(((QuadTree *)index)->root, point, k, found);
+}
+
+static void spatial_quad_clear(void *index)
+{
+    quad_build_from_entities((QuadTree *)index, NULL, 0);
+}
+
+static void spatial_quad_stats(void *index, SpatialStats *stats)
+{
+    QuadStats quad;
+    quad_stats((QuadTree *)index, &quad);
+    stats->entities = quad.entities;
+    stats->nodes = quad.nodes;
+    stats->bytes = sizeof(QuadTree) + quad.bytes;
+}
+
+static void spatial_quad_begin(void *index)
+{
+    quad_batch_begin((QuadTree *)index);
+}
+
+/**
+ * Commit the frame's batch, then spend the compaction budget on whatever
+ * lazy removals have left to merge and lay the nodes out again if they have
+ * scattered.
+ */
+static bool spatial_quad_commit(void *index)
+{
+    QuadTree *quad = (QuadTree *)index;
+    bool applied = quad_batch_commit(quad);
+    quad_compact(quad, QUAD_COMPACT_BUDGET);
+    if (quad_fragmentation(quad) > QUAD_RELAYOUT_THRESHOLD)
+        quad_relayout(quad);
+    return applied;
+}
+
+static void spatial_quad_free(void *index)
+{
+    quad_free_tree((QuadTree *)index);
+}
+
+static bool spatial_grid_insert(void *index, Entity *entity)
+{
+    return grid_insert((SpatialGrid *)index, entity);
+}
+
+static bool spatial_grid_remove(void *index, Entity *entity)
+{
+    return grid_remove((SpatialGrid *)index, entity);
+}
+
+static bool spatial_grid_update(void *index, Entity *entity, SDL_Rect old_position)
+{
+    return grid_update((SpatialGrid *)index, entity, old_position);
+}
+
+static size_t spatial_grid_query_rect(void *index, SDL_Rect rect, QuadVisitor visit, void *data)
+{
+    return grid_visit_rect((SpatialGrid *)index, rect, visit, data);
+}
+
+static Entity *spatial_grid_query_point(void *index, SDL_Rect point)
+{
+    return grid_find_entity((SpatialGrid *)index, point);
+}
+
+static size_t spatial_grid_knn(void *index, SDL_Point point, size_t k, Entity **found)
+{
+    return grid_query_knn((SpatialGrid *)index, point, k, found);
+}
+
+static void spatial_grid_clear(void *index)
+{
+    grid_clear((SpatialGrid *)index);
+}
+
+static void spatial_grid_stats(void *index, SpatialStats *stats)
+{
+    SpatialGrid *grid = (SpatialGrid *)index;
+    stats->entities = grid->count;
+    stats->nodes = 0;
+    stats->bytes = sizeof(SpatialGrid) + sizeof(GridSlot) * grid->slot_count;
+    for (uint32_t s = 0; s < grid->slot_count; s++)
+    {
+        stats->nodes += grid->slots[s].count > 0;
+        stats->bytes += sizeof(GridEntry) * grid->slots[s].maximum;
+    }
+}
+
+static void spatial_grid_free(void *index)
+{
+    grid_free((SpatialGrid *)index);
+}
+
+static bool spatial_aabb_insert(void *index, Entity *entity)
+{
+    return aabb_insert((AABBTree *)index, entity);
+}
+
+static bool spatial_aabb_remove(void *index, Entity *entity)
+{
+    return aabb_remove((AABBTree *)index, entity);
+}
+
+static bool spatial_aabb_update(void *index, Entity *entity, SDL_Rect old_position)
+{
+    return aabb_update((AABBTree *)index, entity, old_position);
+}
+
+static size_t spatial_aabb_query_rect(void *index, SDL_Rect rect, QuadVisitor visit, void *data)
+{
+    return aabb_visit_rect((AABBTree *)index, rect, visit, data);
+}
+
+static Entity *spatial_aabb_query_point(void *index, SDL_Rect point)
+{
+    return aabb_find_entity((AABBTree *)index, point);
+}
+
+static size_t spatial_aabb_knn(void *index, SDL_Point point, size_t k, Entity **found)
+{
+    return aabb_query_knn((AABBTree *)index, point, k, found);
+}
+
+static void spatial_aabb_clear(void *index)
+{
+    aabb_clear((AABBTree *)index);
+}
+
+static void spatial_aabb_stats(void *index, SpatialStats *stats)
+{
+    AABBTree *tree = (AABBTree *)index;
+    stats->entities = tree->count;
+    stats->nodes = tree->node_count;
+    stats->bytes = sizeof(AABBTree) + sizeof(AABBNode) * tree->node_maximum;
+}
+
+static void spatial_aabb_free(void *index)
+{
+    aabb_free((AABBTree *)index);
+}
+
+static bool spatial_lquad_insert(void *index, Entity *entity)
+{
+    return lquad_insert_entity((LinearQuadTree *)index, entity);
+}
+
+static bool spatial_lquad_remove(void *index, Entity *entity)
+{
+    return lquad_detach_entity((LinearQuadTree *)index, entity);
+}
+
+static bool spatial_lquad_update(void *index, Entity *entity, SDL_Rect old_position)
+{
+    return lquad_update_entity((LinearQuadTree *)index, entity, old_position);
+}
+
+static size_t spatial_lquad_query_rect(void *index, SDL_Rect rect, QuadVisitor visit, void *data)
+{
+    return lquad_visit_rect((LinearQuadTree *)index, rect, visit, data);
+}
+
+static Entity *spatial_lquad_query_point(void *index, SDL_Rect point)
+{
+    return lquad_find_entity((LinearQuadTree *)index, point);
+}
+
+static size_t spatial_lquad_knn(void *index, SDL_Point point, size_t k, Entity **found)
+{
+    return lquad_query_knn((LinearQuadTree *)index, point, k, found);
+}
+
+static void spatial_lquad_clear(void *index)
+{
+    lquad_clear((LinearQuadTree *)index);
+}
+
+static void spatial_lquad_stats(void *index, SpatialStats *stats)
+{
+    LinearQuadTree *quad = (LinearQuadTree *)index;
+    stats->entities = (size_t)quad->count + quad->outside_count;
+    stats->bytes = sizeof(LinearQuadTree) +
+                   (sizeof(uint32_t) + sizeof(Entity *)) * quad->maximum +
+                   sizeof(Entity *) * quad->outside_maximum;
+    // Occupied cells of the grid behind the codes.
+    stats->nodes = 0;
+    for (uint32_t i = 0; i < quad->count; i++)
+        stats->nodes += i == 0 || quad->codes[i] != quad->codes[i - 1];
+}
+
+static void spatial_lquad_free(void *index)
+{
+    lquad_free_tree((LinearQuadTree *)index);
+}
+
+static const SpatialOps spatial_quad_ops = {
+    .insert = spatial_quad_insert,
+    .remove = spatial_quad_remove,
+    .update = spatial_quad_update,
+    .query_rect = spatial_quad_query_rect,
+    .query_point = spatial_quad_query_point,
+    .knn = spatial_quad_knn,
+    .clear = spatial_quad_clear,
+    .stats = spatial_quad_stats,
+    .begin = spatial_quad_begin,
+    .commit = spatial_quad_commit,
+    .free = spatial_quad_free,
+};
+
+static const SpatialOps spatial_grid_ops = {
+    .insert = spatial_grid_insert,
+    .remove = spatial_grid_remove,
+    .update = spatial_grid_update,
+    .query_rect = spatial_grid_query_rect,
+    .query_point = spatial_grid_query_point,
+    .knn = spatial_grid_knn,
+    .clear = spatial_grid_clear,
+    .stats = spatial_grid_stats,
+    .begin = NULL,
+    .commit = NULL,
+    .free = spatial_grid_free,
+};
+
+static const SpatialOps spatial_aabb_ops = {
+    .insert = spatial_aabb_insert,
+    .remove = spatial_aabb_remove,
+    .update = spatial_aabb_update,
+    .query_rect = spatial_aabb_query_rect,
+    .query_point = spatial_aabb_query_point,
+    .knn = spatial_aabb_knn,
+    .clear = spatial_aabb_clear,
+    .stats = spatial_aabb_stats,
+    .begin = NULL,
+    .commit = NULL,
+    .free = spatial_aabb_free,
+};
+
+static const SpatialOps spatial_lquad_ops = {
+    .insert = spatial_lquad_insert,
+    .remove = spatial_lquad_remove,
+    .update = spatial_lquad_update,
+    .query_rect = spatial_lquad_query_rect,
+    .query_point = spatial_lquad_query_point,
+    .knn = spatial_lquad_knn,
+    .clear = spatial_lquad_clear,
+    .stats = spatial_lquad_stats,
+    .begin = NULL,
+    .commit = NULL,
+    .free = spatial_lquad_free,
+};
+
+// ---------------- Main functions ----------------
+
+/**
+ * Initialize an empty index of the given kind, bounds is where the entities
+ * are expected to be.
+ */
+bool spatial_init(SpatialIndex *spatial, SpatialKind kind, SDL_Rect bounds)
+{
+    spatial->kind = kind;
+    spatial->ops = NULL;
+    spatial->index = NULL;
+
+    bool ready = false;
+    switch (kind)
+    {
+    case SPATIAL_QUADTREE:
+    {
+        QuadTree *quad = (QuadTree *)malloc(sizeof(QuadTree));
+        if (!quad)
+            break;
+        quad_init_tree(quad, bounds, QUAD_CAPACITY);
+        quad_set_loose(quad, QUAD_LOOSENESS);
+        quad_set_limits(quad, QUAD_MAX_DEPTH, QUAD_MIN_SIZE);
+        quad_set_lazy(quad, QUAD_LAZY);
+        spatial->index = quad;
+        spatial->ops = &spatial_quad_ops;
+        ready = true;
+        break;
+    }
+    case SPATIAL_GRID:
+    {
+        SpatialGrid *grid = (SpatialGrid *)malloc(sizeof(SpatialGrid));
+        if (!grid)
+            break;
+        spatial->index = grid;
+        spatial->ops = &spatial_grid_ops;
+        ready = grid_init(grid, GRID_CELL_SIZE);
+        break;
+    }
+    case SPATIAL_AABB_TREE:
+    {
+        AABBTree *tree = (AABBTree *)malloc(sizeof(AABBTree));
+        if (!tree)
+            break;
+        spatial->index = tree;
+        spatial->ops = &spatial_aabb_ops;
+        ready = aabb_init(tree, AABB_MARGIN);
+        break;
+    }
+    case SPATIAL_LINEAR_QUADTREE:
+    {
+        LinearQuadTree *quad = (LinearQuadTree *)malloc(sizeof(LinearQuadTree));
+        if (!quad)
+            break;
+        spatial->index = quad;
+        spatial->ops = &spatial_lquad_ops;
+        ready = lquad_init_tree(quad, bounds, QUAD_CAPACITY);
+        break;
+    }
+    default:
+        ERROR_LOG("Unknown spatial index kind %d!\n", kind);
+        break;
+    }
+
+    if (!ready)
+    {
+        ERROR_LOG("Unable to initialize the spatial index!\n");
+        free(spatial->index);
+        spatial->index = NULL;
+        spatial->ops = NULL;
+    }
+    return ready;
+}
+
+/**
+ * Free the index.
+ */
+void spatial_free(SpatialIndex *spatial)
+{
+    if (!spatial->ops)
+        return;
+    spatial->ops->free(spatial->index);
+    free(spatial->index);
+    spatial->index = NULL;
+    spatial->ops = NULL;
+}
+
+/**
+ * Insert an entity, queued until the commit if a batch is open.
+ */
+bool spatial_insert(SpatialIndex *spatial, Entity *entity)
+{
+    return spatial->ops->insert(spatial->index, entity);
+}
+
+/**
+ * Remove an entity, queued until the commit if a batch is open. It must not
+ * have moved since it was inserted or last updated.
+ */
+bool spatial_remove(SpatialIndex *spatial, Entity *entity)
+{
+    return spatial->ops->remove(spatial->index, entity);
+}
+
+/**
+ * Move an entity whose position has changed from old_position.
+ */
+bool spatial_update(SpatialIndex *spatial, Entity *entity, SDL_Rect old_position)
+{
+    return spatial->ops->update(spatial->index, entity, old_position);
+}
+
+/**
+ * Visit every entity overlapping rect, returns the number visited.
+ */
+size_t spatial_query_rect(SpatialIndex *spatial, SDL_Rect rect, QuadVisitor visit, void *data)
+{
+    return spatial->ops->query_rect(spatial->index, rect, visit, data);
+}
+
+/**
+ * Returns an entity under the centre of point, or NULL if there is none.
+ */
+Entity *spatial_query_point(SpatialIndex *spatial, SDL_Rect point)
+{
+    return spatial->ops->query_point(spatial->index, point);
+}
+
+/**
+ * Collect the k entities whose centres are closest to point, nearest first.
+ * Returns the number written to found.
+ */
+size_t spatial_knn(SpatialIndex *spatial, SDL_Point point, size_t k, Entity **found)
+{
+    return spatial->ops->knn(spatial->index, point, k, found);
+}
+
+/**
+ * Take every entity out of the index.
+ */
+void spatial_clear(SpatialIndex *spatial)
+{
+    spatial->ops->clear(spatial->index);
+}
+
+/**
+ * Fill stats with what the index is holding on to.
+ */
+void spatial_stats(SpatialIndex *spatial, SpatialStats *stats)
+{
+    spatial->ops->stats(spatial->index, stats);
+}
+
+/**
+ * Start queueing inserts and removals where the structure supports it.
+ */
+void spatial_begin(SpatialIndex *spatial)
+{
+    if (spatial->ops->begin)
+        spatial->ops->begin(spatial->index);
+}
+
+/**
+ * Apply everything queued since spatial_begin.
+ */
+bool spatial_commit(SpatialIndex *spatial)
+{
+    if (spatial->ops->commit)
+        return spatial->ops->commit(spatial->index);
+    return true;
+}
+
+/**
+ * The quad tree behind the index, or NULL if it is another structure.
+ */
+QuadTree *spatial_quadtree(SpatialIndex *spatial)
+{
+    return spatial->kind == SPATIAL_QUADTREE ? (QuadTree *)spatial->index : NULL;
+}
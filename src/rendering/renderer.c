@@ -8,41 +8,92 @@
 #include "../../include/debug.h"
 #include "../../include/game.h"
 #include "../../include/managers/quadtree.h"
+#include "../../include/managers/quadwalk.h"
+#include "../../include/managers/quadlanes.h"
+#include "../../include/managers/spatialindex.h"
 #include "../../include/rendering/renderer.h"
 #include "../../include/rendering/renderertemplates.h"
 #include "../../include/scenes/scene.h"
 #include "../../include/entities/entity.h"
 
 /**
- * Render node if it is within the camera view..
+ * Children at each depth of the walk that reach into the camera view.
  */
-void render_node(QuadTreeNode *node)
+typedef struct RenderCull
 {
-    // Try the children.
-    for (Quadrent q = 0; q < QUADRENTS; q++)
-        if (node->children[q])
-            render_node(node->children[q]);
-
-    if (is_inside(gameData.camera, node->bounds) ||
-        (gameData.debug && node->entity &&
-         is_point_inside(gameData.camera,
-                         get_rect_centre(node->entity->position))))
+    QuadTreeNode *start;
+    unsigned visible[QUAD_WALK_DEPTH + 1];
+} RenderCull;
+
+/**
+ * Skip subtrees the lanes of their parent place outside the camera view,
+ * nothing below them could be drawn.
+ */
+static QuadWalkAction render_cull(QuadTreeNode *node, void *data)
+{
+    RenderCull *cull = (RenderCull *)data;
+    // Children are one block, so their offset is their quadrent.
+    if (node != cull->start &&
+        !(cull->visible[node->parent->depth] & (1u << (node - node->parent->children[TOPLEFT]))))
+        return QUAD_WALK_SKIP;
+
+    if (node->children[TOPLEFT])
+        cull->visible[node->depth] = quad_lanes_overlap(&node->lanes, gameData.camera, NULL);
+    return QUAD_WALK_CONTINUE;
+}
+
+/**
+ * Render a node if it is within the camera view, its children have already
+ * been drawn beneath it.
+ */
+static QuadWalkAction render_visible(QuadTreeNode *node, void *data)
+{
+    bool visible = is_inside(gameData.camera, node->bounds);
+    // In debug mode also show nodes holding an entity the camera can see.
+    for (uint16_t i = 0; gameData.debug && !visible && i < node->count; i++)
+        visible = is_point_inside(gameData.camera,
+                                  get_rect_centre(node->entities[i]->position));
+
+    if (visible)
     {
         // Render entities.
-        if (node->entity)
+        if (node->count > 0)
         {
             // Fill the box in!
             render_rectangle(&node->bounds,
                              (SDL_Color){.r = 0, .g = 0, .b = 255, .a = 127},
                              true);
+        }
+        for (uint16_t i = 0; i < node->count; i++)
+        {
             // Render said entity.
-            if (has_component(node->entity, Render))
-                node->entity->components[Render].call(node->entity);
+            if (has_component(node->entities[i], Render))
+                node->entities[i]->components[Render].call(node->entities[i]);
         }
         render_rectangle(&node->bounds,
                          (SDL_Color){.r = 255, .g = 255, .b = 255, .a = 255},
                          false);
     }
+    return QUAD_WALK_CONTINUE;
+}
+
+/**
+ * Render node and everything below it within the camera view.
+ */
+void render_node(QuadTreeNode *node)
+{
+    RenderCull cull = {.start = node};
+    quad_walk(node, render_cull, render_visible, &cull);
+}
+
+/**
+ * Render an entity within the camera view.
+ */
+static bool render_entity(Entity *entity, void *data)
+{
+    if (has_component(entity, Render))
+        entity->components[Render].call(entity);
+    return true;
 }
 
 /**
@@ -50,5 +101,10 @@ void render_node(QuadTreeNode *node)
  */
 void render_entities(Scene *currentScene)
 {
-    render_node(gameData.scene->spacial.root);
+    // Only the quad tree has nodes worth drawing.
+    QuadTree *quad = spatial_quadtree(&gameData.scene->spacial);
+    if (quad)
+        render_node(quad->root);
+    else
+        spatial_query_rect(&gameData.scene->spacial, gameData.camera, &render_entity, NULL);
 }
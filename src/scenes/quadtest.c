@@ -1,8 +1,9 @@
 #include <stdlib.h>
 #include <math.h>
 
+#include "../../include/config.h"
 #include "../../include/debug.h"
-#include "../../include/managers/quadtree.h"
+#include "../../include/managers/spatialindex.h"
 #include "../../include/game.h"
 #include "../../include/entities/entity.h"
 #include "../../include/entities/state.h"
@@ -18,16 +19,16 @@ static void click_handler(GameData *gameData, bool *right_down)
     if (gameData->event.button.button == SDL_BUTTON_LEFT)
     {
         // Fetch the component via the quadtree.
-        QuadTreeNode *found = quad_find_entity(gameData->scene->spacial.root,
-                                               (SDL_Rect){.x = x, .y = y});
+        Entity *found = spatial_query_point(&gameData->scene->spacial,
+                                            (SDL_Rect){.x = x, .y = y});
         if (!found)
             return;
 
-        if (!has_component(found->entity, LeftClicked))
+        if (!has_component(found, LeftClicked))
             return;
 
         DEBUG_LOG("Click at x: %d, y:%d\n", x, y);
-        found->entity->components[LeftClicked].call(found->entity);
+        found->components[LeftClicked].call(found);
         return;
     }
     if (gameData->event.button.button == SDL_BUTTON_RIGHT)
@@ -184,7 +185,7 @@ static void event_handler(void)
  */
 void init_quadtest_scene(void)
 {
-    if (!init_scene(gameData.scene))
+    if (!init_scene(gameData.scene, SPATIAL_INDEX))
     {
         gameData.scene = NULL;
         return;
@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
+#include "../../include/config.h"
 #include "../../include/debug.h"
 #include "../../include/util/camera.h"
 #include "../../include/game.h"
@@ -10,12 +11,14 @@
 #include "../../include/rendering/renderertemplates.h"
 
 /**
- * Initialize the scene components.
+ * Initialize the scene components, indexing entities with the given kind of
+ * structure.
  */
-bool init_scene(Scene *scene)
+bool init_scene(Scene *scene, SpatialKind kind)
 {
-    DEBUG_LOG("Initializing the quad tree\n");
-    quad_init_tree(&scene->spacial, gameData.camera);
+    DEBUG_LOG("Initializing the spacial index\n");
+    if (!spatial_init(&scene->spacial, kind, gameData.camera))
+        return false;
 
     if (!init_entity_manager(&scene->entities))
     {
@@ -41,7 +44,7 @@ void free_scene(Scene *scene)
         DEBUG_LOG("Scene already freed.\n");
         return;
     }
-    quad_free_tree(&scene->spacial);
+    spatial_free(&scene->spacial);
     free_entities(&scene->entities);
     DEBUG_LOG("Freeing entities.\n");
     // Remove event handler pointer.
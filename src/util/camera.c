@@ -124,11 +124,16 @@ bool is_collision(int x, int y, SDL_Rect position)
 }
 
 /**
- * Check if provided rects overlap.
+ * Check if provided rects overlap, sharing an edge is not enough and an
+ * empty rect overlaps nothing.
  */
 bool is_overlap(SDL_Rect dest, SDL_Rect position)
 {
-    return SDL_IntersectRect(&dest, &position, NULL);
+    if (dest.w <= 0 || dest.h <= 0 || position.w <= 0 || position.h <= 0)
+        return false;
+
+    return dest.x < position.x + position.w && position.x < dest.x + dest.w &&
+           dest.y < position.y + position.h && position.y < dest.y + dest.h;
 }
 
 /**
@@ -165,11 +170,12 @@ bool is_point_inside(SDL_Rect within, SDL_Point point)
            point.y > within.y && point.y < within.y + within.h;
 }
 
+/**
+ * Get the quadrent of the point around the centre, points on the centre lines
+ * belong to the right and bottom quadrents like the bounds of a split.
+ */
 Quadrent get_dir(SDL_Point centre, SDL_Point point)
 {
-    if (point.x == centre.x && point.y == centre.y)
-        return TOPLEFT; // DIRECTIONS; Only one per node at the moment.
-
     if (point.x < centre.x)
     {
         if (point.y < centre.y)
@@ -186,3 +192,30 @@ Quadrent get_dir(SDL_Point centre, SDL_Point point)
     }
     return TOPLEFT; // DIRECTIONS; Only one per node at the moment.
 }
+
+/**
+ * Spread the lower 16 bits of value out to every other bit.
+ */
+static uint32_t spread_bits(uint32_t value)
+{
+    value &= 0x0000FFFF;
+    value = (value | (value << 8)) & 0x00FF00FF;
+    value = (value | (value << 4)) & 0x0F0F0F0F;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+/**
+ * Get the Morton (Z-order) code of a point on a 65536 x 65536 grid laid over
+ * the provided rectangle, points outside are clamped to the edge.
+ */
+uint32_t get_morton_code(SDL_Rect within, SDL_Point point)
+{
+    int64_t x = within.w > 0 ? ((int64_t)point.x - within.x) * 65536 / within.w : 0;
+    int64_t y = within.h > 0 ? ((int64_t)point.y - within.y) * 65536 / within.h : 0;
+    x = x < 0 ? 0 : x > 0xFFFF ? 0xFFFF : x;
+    y = y < 0 ? 0 : y > 0xFFFF ? 0xFFFF : y;
+    // The y bit is the high bit so codes follow the Quadrent order.
+    return spread_bits((uint32_t)x) | (spread_bits((uint32_t)y) << 1);
+}